@@ -13,6 +13,10 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 // Project Includes
 #include <fs3_driver.h>
@@ -21,277 +25,2163 @@
 #include <fs3_cache.h>
 #include <fs3_common.h>
 #include <fs3_network.h>
+#include <fs3_mrc.h>
 
 // 
 // Support Macros/Data
+#define LINE_DATA(idx) (cacheArena + (size_t)(idx) * FS3_SECTOR_SIZE) // Sector data of a cache line
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024) // Explicit huge page size the arena is rounded up to
+#define SECTOR_TAG(trk, sct) ((uint32_t)(trk) * FS3_TRACK_SIZE + (sct) + 1) // Set-associative tag, 0 is an empty way
+#define VALID_WORD_BITS 64 // Sectors tracked by each word of the validity bitmap
 
 //
 // Global Variables
 FS3Cache *cache       = NULL; // Pointer to the cache memory location
-int16_t cacheSize = -1, cacheItems =  0;  // Cache parameters
+int32_t cacheSize = -1, cacheItems =  0;  // Cache parameters
 int32_t nextAccess = 0, cacheGets = 0, cacheInserts = 0, cacheMisses = 0, cacheHits = 0; // Cache statistics   
+int8_t cacheWriteBack = 0;                                          // 1 if writes stay in the cache until flushed
+uint8_t dirtyLowPct = FS3_DEFAULT_DIRTY_LOW, dirtyHighPct = FS3_DEFAULT_DIRTY_HIGH; // Background flusher watermarks
+int32_t cacheDirty = 0;                                             // Lines newer than the disk
+int32_t cacheDirtyWrites = 0, cacheFlushes = 0;                     // Write-back statistics
+int32_t cachePrefetches = 0, cachePrefetchHits = 0, cachePrefetchWaste = 0; // Readahead and group fill statistics
 
+// Indexes over the cache lines
+int32_t *cacheHash = NULL;                 // Hash buckets, first line of each chain or -1
+uint32_t cacheHashMask = 0;                // Number of buckets - 1 (a power of two)
+int32_t qHead[2] = {-1, -1}, qTail[2] = {-1, -1}; // Newest / oldest line of each policy list, -1 if empty
+int32_t qSize[2] = {0, 0};                 // Lines on each policy list
+int32_t freeLine = -1;                     // First never used line (chained through lnext), -1 if none
+int32_t dirtyHead[FS3_MAX_TRACKS];         // First dirty line of each track, -1 if none
+uint64_t cacheValid[FS3_MAX_TRACKS][FS3_TRACK_SIZE / VALID_WORD_BITS]; // Validity bitmap, bit set if the sector is cached
+
+// Line data, one page aligned arena of cacheSize sectors
+char *cacheArena = NULL;                           // Start of the arena
+size_t cacheArenaBytes = 0;                        // Mapped size of the arena
+FS3CachePages cachePages = FS3_CACHE_PAGES_NORMAL; // Pages asked for at the next init
+FS3CachePages cachePagesUsed = FS3_CACHE_PAGES_NORMAL; // Pages the arena actually got
+
+// Replacement policy
+FS3CachePolicy cachePolicy = FS3_CACHE_LRU; // Policy picking the line a miss replaces
+int32_t clockHand = 0;                      // Next line the clock looks at (CLOCK)
+int32_t arcTarget = 0;                      // Target size of T1 (ARC)
+FS3Ghost *ghosts = NULL;                    // Recently evicted sectors (2Q, ARC, S3-FIFO)
+int32_t *ghostHash = NULL;                  // Hash buckets of the ghosts, same count as the cache's
+int32_t ghostFree = -1;                     // First unused ghost entry (chained through gnext)
+int32_t gHead[2] = {-1, -1}, gTail[2] = {-1, -1}; // Newest / oldest entry of each ghost list
+int32_t gSize[2] = {0, 0};                  // Entries on each ghost list
+
+// Set-associative organization, line "idx" is way idx % cacheWays of set idx / cacheWays
+uint8_t cacheWays = 0;                      // Ways per set, 0 for a fully associative cache
+uint8_t cacheWaysNext = 0;                  // Ways asked for at the next init
+int32_t cacheSets = 0;                      // Number of sets
+uint32_t *cacheTags = NULL;                 // Tag of every line, packed set by set for SIMD compares
+uint16_t *cachePlru = NULL;                 // Tree pseudo-LRU bits of every set (bit n is tree node n)
+
+// Admission filter
+FS3CacheAdmit cacheAdmit = FS3_ADMIT_ALL;   // Which clean sectors that miss get a line
+uint8_t *sketch = NULL;                     // Count-min frequency sketch, FS3_SKETCH_ROWS rows of counters
+uint32_t sketchMask = 0;                    // Counters per row - 1 (a power of two)
+int32_t sketchUses = 0;                     // Uses counted since the sketch was last aged
+int32_t lastUseKey = -1;                    // Sector of the last use, a put of it right after is the same use
+int32_t cacheRejects = 0;                   // Sectors the filter kept out of the cache
+
+// Auto sizing from the miss ratio curve
+int8_t cacheAutoTune = 0;                   // 1 if the cache resizes itself
+double cacheAutoPct = 0.0;                  // Hit ratio points the cache may give up for being smaller
+int32_t cacheAutoMax = 0;                   // Largest size auto sizing may pick, in lines
+int32_t cacheUses = 0, cacheAutoLast = 0;   // Uses counted, and at the last auto sizing check
+int32_t cacheAutoResizes = 0;               // Resizes auto sizing made
+
+// Unit tests
+int8_t cacheAllocFault = 0;                 // 1 makes the next fs3_cache_alloc fail after the indexes are allocated
+
+//
+// Implementation
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_hash_idx
+// Description  : Returns the hash bucket of a track / sector
+//
+// Inputs       : trk - the track number of the sector
+//                sct - the sector number of the sector
+// Outputs      : bucket index
+
+uint32_t fs3_hash_idx(FS3TrackIndex trk, FS3SectorIndex sct){
+
+    // Mix the combined sector number so neighbouring sectors spread out
+    uint32_t key = ((uint32_t)trk * FS3_TRACK_SIZE + sct) * 2654435761u;
+    return((key >> 16) & cacheHashMask);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_find_line
+// Description  : Looks a track / sector up in the hash index
+//
+// Inputs       : trk - the track number of the sector
+//                sct - the sector number of the sector
+// Outputs      : cache line index if present, -1 if not
+        
+int32_t fs3_find_line(FS3TrackIndex trk, FS3SectorIndex sct){
+
+    // Set-associative, compare the tags of one set
+    if(cacheWays){
+        return(fs3_set_find(trk, sct));
+    }
+            
+    // Walk the chain of the bucket
+    for(int32_t i = cacheHash[fs3_hash_idx(trk, sct)]; i != -1; i = (cache + i) -> hnext){
+        if( (cache + i) -> ctrk == trk && (cache + i) -> csec == sct){
+            return(i);
+        }
+    }
+
+    return(-1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_hash_remove
+// Description  : Takes a cache line out of the hash index
+//
+// Inputs       : idx - the cache line
+// Outputs      : none
+
+void fs3_hash_remove(int32_t idx){
+
+    // No longer valid
+    int16_t sct = (cache + idx) -> csec;
+    cacheValid[(cache + idx) -> ctrk][sct / VALID_WORD_BITS] &= ~(1ULL << (sct % VALID_WORD_BITS));
+
+    // Set-associative, the way just loses its tag
+    if(cacheWays){
+        cacheTags[idx] = 0;
+        return;
+    }
+
+    // Find the link pointing at the line and skip over it
+    int32_t *link = &cacheHash[fs3_hash_idx((cache + idx) -> ctrk, (cache + idx) -> csec)];
+    while(*link != idx){
+        link = &(cache + *link) -> hnext;
+    }
+    *link = (cache + idx) -> hnext;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_hash_add
+// Description  : Puts a cache line into the hash index under its track / sector
+//
+// Inputs       : idx - the cache line
+// Outputs      : none
+
+void fs3_hash_add(int32_t idx){
+
+    // Valid from now on
+    int16_t sct = (cache + idx) -> csec;
+    cacheValid[(cache + idx) -> ctrk][sct / VALID_WORD_BITS] |= 1ULL << (sct % VALID_WORD_BITS);
+
+    // Set-associative, the line is already in the right set
+    if(cacheWays){
+        cacheTags[idx] = SECTOR_TAG((cache + idx) -> ctrk, (cache + idx) -> csec);
+        return;
+    }
+
+    uint32_t bucket = fs3_hash_idx((cache + idx) -> ctrk, (cache + idx) -> csec);
+    (cache + idx) -> hnext = cacheHash[bucket];
+    cacheHash[bucket] = idx;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_set_idx
+// Description  : Returns the set a track / sector maps to (set-associative)
+//
+// Inputs       : trk - the track number of the sector
+//                sct - the sector number of the sector
+// Outputs      : set index
+
+int32_t fs3_set_idx(FS3TrackIndex trk, FS3SectorIndex sct){
+
+    // Same mixing as the hash index, the set count need not be a power of two
+    uint32_t key = ((uint32_t)trk * FS3_TRACK_SIZE + sct) * 2654435761u;
+    return((key >> 16) % cacheSets);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_set_find
+// Description  : Looks a track / sector up by comparing the packed tags of its
+//                set, eight (AVX2) or four (SSE2) ways per instruction
+//
+// Inputs       : trk - the track number of the sector
+//                sct - the sector number of the sector
+// Outputs      : cache line index if present, -1 if not
+
+int32_t fs3_set_find(FS3TrackIndex trk, FS3SectorIndex sct){
+
+    // Local variables
+    uint32_t tag   = SECTOR_TAG(trk, sct);
+    int32_t base   = fs3_set_idx(trk, sct) * cacheWays;
+    uint32_t *tags = cacheTags + base;
+    int32_t w      = 0;
+    int mask;
+
+#ifdef __AVX2__
+    __m256i tag8 = _mm256_set1_epi32((int)tag);
+    for(; w + 8 <= cacheWays; w += 8){
+        mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_loadu_si256((__m256i *)(tags + w)), tag8)));
+        if(mask){
+            return(base + w + __builtin_ctz(mask));
+        }
+    }
+#endif
+#ifdef __SSE2__
+    __m128i tag4 = _mm_set1_epi32((int)tag);
+    for(; w + 4 <= cacheWays; w += 4){
+        mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128((__m128i *)(tags + w)), tag4)));
+        if(mask){
+            return(base + w + __builtin_ctz(mask));
+        }
+    }
+#endif
+
+    // Ways left over (or no SIMD)
+    for(; w < cacheWays; w++){
+        if(tags[w] == tag){
+            return(base + w);
+        }
+    }
+    (void)mask;
+
+    return(-1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_plru_touch
+// Description  : Points the pseudo-LRU tree of a line's set away from the line
+//
+// Inputs       : idx - the cache line
+// Outputs      : none
+
+void fs3_plru_touch(int32_t idx){
+
+    // Local variables
+    int32_t set = idx / cacheWays;
+    int32_t way = idx % cacheWays;
+    int32_t node = 1;
+
+    // Walk down from the root, each node on the path points at the other half
+    for(int32_t half = cacheWays / 2; half > 0; half /= 2){
+        int32_t right = (way & half) != 0;
+        if(right){
+            cachePlru[set] &= ~(1u << node);
+        }else{
+            cachePlru[set] |= (1u << node);
+        }
+        node = 2 * node + right;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_set_place
+// Description  : Picks the line of a track / sector's set it goes in, an empty
+//                way if there is one, otherwise the pseudo-LRU way
+//
+// Inputs       : trk - the track number of the sector
+//                sct - the sector number of the sector
+// Outputs      : cache line index
+
+int32_t fs3_set_place(FS3TrackIndex trk, FS3SectorIndex sct){
+
+    // Local variables
+    int32_t set  = fs3_set_idx(trk, sct);
+    int32_t node = 1;
+
+    // Empty ways first
+    for(int32_t w = 0; w < cacheWays; w++){
+        if(cacheTags[set * cacheWays + w] == 0){
+            return(set * cacheWays + w);
+        }
+    }
+
+    // Follow the tree bits down to the pseudo least recently used way
+    while(node < cacheWays){
+        node = 2 * node + ((cachePlru[set] >> node) & 1);
+    }
+
+    return(set * cacheWays + node - cacheWays);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_set_cache_ways
+// Description  : Select a set-associative cache with "ways" lines per set, or a
+//                fully associative one (0), takes effect at the next fs3_init_cache
+//
+// Inputs       : ways - ways per set, 0 or a power of two up to 16
+// Outputs      : 0 if successful, -1 if failure
+
+int fs3_set_cache_ways(uint8_t ways) {
+
+    // Failure condition
+    if(ways > 16 || (ways & (ways - 1)) != 0){
+        logMessage(LOG_INFO_LEVEL, "Cache ways [%d] must be 0 or a power of two up to 16.", ways);
+        return(-1);
+    }
+
+    cacheWaysNext = ways;
+    return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_queue_unlink
+// Description  : Takes a cache line out of the policy list it is on
+//
+// Inputs       : idx - the cache line
+// Outputs      : none
+
+void fs3_queue_unlink(int32_t idx){
+    int8_t q = (cache + idx) -> cqueue;
+
+    // Neighbours point past the line
+    if((cache + idx) -> lprev != -1){
+        (cache + (cache + idx) -> lprev) -> lnext = (cache + idx) -> lnext;
+    }else{
+        qHead[q] = (cache + idx) -> lnext;
+    }
+    if((cache + idx) -> lnext != -1){
+        (cache + (cache + idx) -> lnext) -> lprev = (cache + idx) -> lprev;
+    }else{
+        qTail[q] = (cache + idx) -> lprev;
+    }
+    qSize[q]--;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_queue_push
+// Description  : Puts a cache line at the head (newest end) of a policy list
+//
+// Inputs       : idx - the cache line (must not be on a list)
+//                q - the list, 0 or 1 (what they hold depends on the policy)
+// Outputs      : none
+
+void fs3_queue_push(int32_t idx, int8_t q){
+
+    // Push onto the head of the list
+    (cache + idx) -> cqueue = q;
+    (cache + idx) -> lprev = -1;
+    (cache + idx) -> lnext = qHead[q];
+    if(qHead[q] != -1){
+        (cache + qHead[q]) -> lprev = idx;
+    }else{
+        qTail[q] = idx;
+    }
+    qHead[q] = idx;
+    qSize[q]++;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_set_dirty
+// Description  : Marks a cache line dirty or clean, keeping the dirty list of its
+//                track up to date
+//
+// Inputs       : idx - the cache line
+//                dirty - 1 if the line is newer than the disk, 0 if not
+// Outputs      : none
+
+void fs3_set_dirty(int32_t idx, int8_t dirty){
+    FS3Cache *line = cache + idx;
+
+    // Nothing changes
+    if(line -> dirty == dirty){
+        return;
+    }
+
+    if(dirty){
+        // Push onto the dirty list of the track
+        line -> dprev = -1;
+        line -> dnext = dirtyHead[line -> ctrk];
+        if(line -> dnext != -1){
+            (cache + line -> dnext) -> dprev = idx;
+        }
+        dirtyHead[line -> ctrk] = idx;
+        cacheDirty++;
+    }else{
+        // Take out of the dirty list of the track
+        if(line -> dprev != -1){
+            (cache + line -> dprev) -> dnext = line -> dnext;
+        }else{
+            dirtyHead[line -> ctrk] = line -> dnext;
+        }
+        if(line -> dnext != -1){
+            (cache + line -> dnext) -> dprev = line -> dprev;
+        }
+        cacheDirty--;
+    }
+
+    line -> dirty = dirty;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_ghost_find
+// Description  : Looks a track / sector up among the ghost entries (sectors the
+//                policy evicted recently and still remembers)
+//
+// Inputs       : trk - the track number of the sector
+//                sct - the sector number of the sector
+// Outputs      : ghost entry index if present, -1 if not
+
+int32_t fs3_ghost_find(FS3TrackIndex trk, FS3SectorIndex sct){
+
+    // Walk the chain of the bucket
+    for(int32_t g = ghostHash[fs3_hash_idx(trk, sct)]; g != -1; g = (ghosts + g) -> ghnext){
+        if( (ghosts + g) -> gtrk == trk && (ghosts + g) -> gsec == sct){
+            return(g);
+        }
+    }
+
+    return(-1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_ghost_remove
+// Description  : Forgets a ghost entry, taking it off its list and the ghost hash
+//
+// Inputs       : g - the ghost entry
+// Outputs      : none
+
+void fs3_ghost_remove(int32_t g){
+    FS3Ghost *ghost = ghosts + g;
+
+    // Skip over it in the hash chain
+    int32_t *link = &ghostHash[fs3_hash_idx(ghost -> gtrk, ghost -> gsec)];
+    while(*link != g){
+        link = &(ghosts + *link) -> ghnext;
+    }
+    *link = ghost -> ghnext;
+
+    // Skip over it in its list
+    if(ghost -> gprev != -1){
+        (ghosts + ghost -> gprev) -> gnext = ghost -> gnext;
+    }else{
+        gHead[ghost -> glist] = ghost -> gnext;
+    }
+    if(ghost -> gnext != -1){
+        (ghosts + ghost -> gnext) -> gprev = ghost -> gprev;
+    }else{
+        gTail[ghost -> glist] = ghost -> gprev;
+    }
+    gSize[ghost -> glist]--;
+
+    // Back on the free list
+    ghost -> gnext = ghostFree;
+    ghostFree = g;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_ghost_add
+// Description  : Remembers an evicted track / sector at the head of a ghost list,
+//                forgetting the oldest entries past "cap"
+//
+// Inputs       : list - the ghost list
+//                trk - the track number of the sector
+//                sct - the sector number of the sector
+//                cap - most entries the list may hold
+// Outputs      : none
+
+void fs3_ghost_add(int8_t list, FS3TrackIndex trk, FS3SectorIndex sct, int32_t cap){
+
+    // Make room on the list (and in the pool)
+    while(gTail[list] != -1 && (gSize[list] >= cap || ghostFree == -1)){
+        fs3_ghost_remove(gTail[list]);
+    }
+    if(ghostFree == -1 || cap <= 0){
+        return;
+    }
+
+    // Take an entry off the free list
+    int32_t g = ghostFree;
+    FS3Ghost *ghost = ghosts + g;
+    ghostFree = ghost -> gnext;
+    ghost -> gtrk  = trk;
+    ghost -> gsec  = sct;
+    ghost -> glist = list;
+
+    // Push onto the head of the list
+    ghost -> gprev = -1;
+    ghost -> gnext = gHead[list];
+    if(gHead[list] != -1){
+        (ghosts + gHead[list]) -> gprev = g;
+    }else{
+        gTail[list] = g;
+    }
+    gHead[list] = g;
+    gSize[list]++;
+
+    // Into the ghost hash
+    uint32_t bucket = fs3_hash_idx(trk, sct);
+    ghost -> ghnext = ghostHash[bucket];
+    ghostHash[bucket] = g;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_lru_idx
+// Description  : Returns the least reacently used cache line index (LRU policy)
+//
+// Inputs       : none
+// Outputs      : Least Recently Used Index if successful, -1 if failure
+
+int32_t fs3_lru_idx(void){
+
+    // The tail of the recency list
+    logMessage(LOG_INFO_LEVEL, "LRU idx = %d", qTail[0]);
+    return(qTail[0]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_clock_idx
+// Description  : Sweeps the clock hand past referenced lines, clearing their
+//                reference bits, and returns the first unreferenced one (CLOCK)
+//
+// Inputs       : none
+// Outputs      : victim cache line index
+
+int32_t fs3_clock_idx(void){
+
+    // The hand walks the lines in order, passing unused ones (left by a resize)
+    while((cache + clockHand) -> cref || (cache + clockHand) -> ctrk == -1){
+        (cache + clockHand) -> cref = 0;
+        clockHand = (clockHand + 1) % cacheSize;
+    }
+
+    int32_t victim = clockHand;
+    clockHand = (clockHand + 1) % cacheSize;
+    return(victim);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_2q_idx
+// Description  : Evicts from the first-touch FIFO (A1in) while it is over its
+//                share, remembering the sector in A1out, and otherwise from the
+//                LRU of lines touched again (Am) (2Q)
+//
+// Inputs       : none
+// Outputs      : victim cache line index
+
+int32_t fs3_2q_idx(void){
+
+    // Local variables
+    int32_t kin  = (cacheSize / 4 > 0) ? cacheSize / 4 : 1; // Share of A1in
+    int32_t kout = (cacheSize / 2 > 0) ? cacheSize / 2 : 1; // Size of A1out
+
+    if(qSize[0] > kin || qSize[1] == 0){
+        int32_t victim = qTail[0];
+        fs3_ghost_add(0, (cache + victim) -> ctrk, (cache + victim) -> csec, kout);
+        return(victim);
+    }
+
+    return(qTail[1]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_arc_replace
+// Description  : ARC's REPLACE, evicts the LRU of T1 or T2 depending on the target
+//                size of T1, remembering it in the matching ghost list (ARC)
+//
+// Inputs       : inB2 - 1 if the sector being brought in was a B2 ghost
+// Outputs      : victim cache line index
+
+int32_t fs3_arc_replace(int8_t inB2){
+
+    // Local variables
+    int32_t victim;
+
+    if(qSize[0] > 0 && ((inB2 && qSize[0] == arcTarget) || qSize[0] > arcTarget || qSize[1] == 0)){
+        victim = qTail[0];
+        fs3_ghost_add(0, (cache + victim) -> ctrk, (cache + victim) -> csec, cacheSize);
+    }else{
+        victim = qTail[1];
+        fs3_ghost_add(1, (cache + victim) -> ctrk, (cache + victim) -> csec, cacheSize);
+    }
+
+    return(victim);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_arc_place
+// Description  : Adapts ARC to a miss on a track / sector and picks the line it
+//                goes in (ARC)
+//
+// Inputs       : trk - the track number of the sector
+//                sct - the sector number of the sector
+//                queue - set to the list the sector goes on (0 = T1, 1 = T2)
+// Outputs      : victim cache line index, -1 to use a free line
+
+int32_t fs3_arc_place(FS3TrackIndex trk, FS3SectorIndex sct, int8_t *queue){
+
+    // Local variables
+    int32_t g = fs3_ghost_find(trk, sct);
+    int32_t delta;
+
+    // Ghosts only exist once the cache has filled up
+    if(freeLine != -1){
+        *queue = 0;
+        return(-1);
+    }
+
+    if(g != -1 && (ghosts + g) -> glist == 0){
+        // Hit in B1, T1 should have been bigger
+        delta = (gSize[1] > gSize[0]) ? gSize[1] / gSize[0] : 1;
+        arcTarget = (arcTarget + delta < cacheSize) ? arcTarget + delta : cacheSize;
+        fs3_ghost_remove(g);
+        *queue = 1;
+        return(fs3_arc_replace(0));
+    }
+
+    if(g != -1){
+        // Hit in B2, T2 should have been bigger
+        delta = (gSize[0] > gSize[1]) ? gSize[0] / gSize[1] : 1;
+        arcTarget = (arcTarget - delta > 0) ? arcTarget - delta : 0;
+        fs3_ghost_remove(g);
+        *queue = 1;
+        return(fs3_arc_replace(1));
+    }
+
+    // Not seen recently, goes on T1
+    *queue = 0;
+    if(qSize[0] + gSize[0] >= cacheSize){
+        if(qSize[0] < cacheSize){
+            fs3_ghost_remove(gTail[0]);
+            return(fs3_arc_replace(0));
+        }
+        return(qTail[0]); // T1 fills the cache, drop its LRU without a ghost
+    }
+
+    if(qSize[0] + qSize[1] + gSize[0] + gSize[1] >= 2 * cacheSize && gTail[1] != -1){
+        fs3_ghost_remove(gTail[1]);
+    }
+    return(fs3_arc_replace(0));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_s3fifo_idx
+// Description  : Evicts from the small FIFO while it is over its share, promoting
+//                lines touched again to the main FIFO, and otherwise from the main
+//                FIFO, giving lines touched since another lap (S3-FIFO)
+//
+// Inputs       : none
+// Outputs      : victim cache line index
+
+int32_t fs3_s3fifo_idx(void){
+
+    // Local variables
+    int32_t small = (cacheSize / 10 > 0) ? cacheSize / 10 : 1; // Share of the small FIFO
+    int32_t line;
+
+    while(1){
+        if(qSize[0] > 0 && (qSize[0] >= small || qSize[1] == 0)){
+
+            // Oldest of the small FIFO, promoted if it was touched again
+            line = qTail[0];
+            if((cache + line) -> cref > 1){
+                fs3_queue_unlink(line);
+                fs3_queue_push(line, 1);
+                (cache + line) -> cref = 0;
+                continue;
+            }
+
+            // Otherwise it goes, remembered in the ghost FIFO
+            fs3_ghost_add(0, (cache + line) -> ctrk, (cache + line) -> csec, cacheSize - small);
+            return(line);
+        }
+
+        // Oldest of the main FIFO, another lap if it was touched
+        line = qTail[1];
+        if((cache + line) -> cref > 0){
+            fs3_queue_unlink(line);
+            fs3_queue_push(line, 1);
+            (cache + line) -> cref--;
+            continue;
+        }
+
+        return(line);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_policy_place
+// Description  : Asks the replacement policy where a sector that missed goes: the
+//                list it joins, and the line it replaces when the cache is full
+//
+// Inputs       : trk - the track number of the sector
+//                sct - the sector number of the sector
+//                queue - set to the list of the policy the sector goes on
+// Outputs      : victim cache line index, -1 to use a free line
+
+int32_t fs3_policy_place(FS3TrackIndex trk, FS3SectorIndex sct, int8_t *queue){
+
+    // Local variables
+    int32_t g;
+
+    switch(cachePolicy){
+    case FS3_CACHE_CLOCK:
+        *queue = 0;
+        return((freeLine != -1) ? -1 : fs3_clock_idx());
+
+    case FS3_CACHE_2Q:
+        // Sectors remembered in A1out were touched again, they go on Am
+        g = fs3_ghost_find(trk, sct);
+        *queue = (g != -1);
+        if(g != -1){
+            fs3_ghost_remove(g);
+        }
+        return((freeLine != -1) ? -1 : fs3_2q_idx());
+
+    case FS3_CACHE_ARC:
+        return(fs3_arc_place(trk, sct, queue));
+
+    case FS3_CACHE_S3FIFO:
+        // Sectors remembered in the ghost FIFO go straight to the main FIFO
+        g = fs3_ghost_find(trk, sct);
+        *queue = (g != -1);
+        if(g != -1){
+            fs3_ghost_remove(g);
+        }
+        return((freeLine != -1) ? -1 : fs3_s3fifo_idx());
+
+    default:
+        *queue = 0;
+        return((freeLine != -1) ? -1 : fs3_lru_idx());
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_policy_hit
+// Description  : Tells the replacement policy a cached line was used again
+//
+// Inputs       : idx - the cache line
+// Outputs      : none
+
+void fs3_policy_hit(int32_t idx){
+
+    // Update access time
+    (cache + idx) -> lastAccess = nextAccess;
+    nextAccess++;
+
+    // Set-associative caches replace within the set by pseudo-LRU, list 0 only
+    // keeps the recency order for the flusher and for resizing
+    if(cacheWays){
+        fs3_plru_touch(idx);
+        fs3_queue_unlink(idx);
+        fs3_queue_push(idx, 0);
+        return;
+    }
+
+    switch(cachePolicy){
+    case FS3_CACHE_CLOCK:
+        (cache + idx) -> cref = 1;
+        break;
+
+    case FS3_CACHE_2Q:
+        // Only Am is kept in recency order, A1in stays a FIFO
+        if((cache + idx) -> cqueue == 1){
+            fs3_queue_unlink(idx);
+            fs3_queue_push(idx, 1);
+        }
+        break;
+
+    case FS3_CACHE_ARC:
+        // A second touch moves the line to T2
+        fs3_queue_unlink(idx);
+        fs3_queue_push(idx, 1);
+        break;
+
+    case FS3_CACHE_S3FIFO:
+        if((cache + idx) -> cref < 3){
+            (cache + idx) -> cref++;
+        }
+        break;
+
+    default:
+        fs3_queue_unlink(idx);
+        fs3_queue_push(idx, 0);
+        break;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_policy_peek
+// Description  : Returns the line the replacement policy would most likely pick
+//                next, without moving anything (used to judge admissions)
+//
+// Inputs       : none
+// Outputs      : cache line index, -1 if the cache still has free lines
+
+int32_t fs3_policy_peek(void){
+
+    // Nothing gets replaced yet
+    if(freeLine != -1 || qSize[0] + qSize[1] == 0){
+        return(-1);
+    }
+
+    switch(cachePolicy){
+    case FS3_CACHE_CLOCK:
+        return(clockHand);
+
+    case FS3_CACHE_ARC:
+        return((qSize[0] > arcTarget || qSize[1] == 0) ? qTail[0] : qTail[1]);
+
+    case FS3_CACHE_2Q:
+    case FS3_CACHE_S3FIFO:
+        return((qSize[0] > 0) ? qTail[0] : qTail[1]);
+
+    default:
+        return(qTail[0]);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_sketch_slot
+// Description  : Returns the counter of a track / sector in one row of the
+//                count-min frequency sketch
+//
+// Inputs       : row - the row of the sketch
+//                trk - the track number of the sector
+//                sct - the sector number of the sector
+// Outputs      : index of the counter in the sketch
+
+uint32_t fs3_sketch_slot(int row, FS3TrackIndex trk, FS3SectorIndex sct){
+
+    // One odd multiplier per row keeps the rows independent enough
+    static const uint32_t seeds[FS3_SKETCH_ROWS] = {0x9E3779B1u, 0x85EBCA77u, 0xC2B2AE3Du, 0x27D4EB2Fu};
+    uint32_t key = ((uint32_t)trk * FS3_TRACK_SIZE + sct + 1) * seeds[row];
+    return(row * (sketchMask + 1) + ((key >> 12) & sketchMask));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_sketch_add
+// Description  : Counts a use of a track / sector, halving every counter once
+//                the sketch has seen ten uses per cache line so old popularity
+//                fades
+//
+// Inputs       : trk - the track number of the sector
+//                sct - the sector number of the sector
+// Outputs      : none
+
+void fs3_sketch_add(FS3TrackIndex trk, FS3SectorIndex sct){
+
+    // No filter, nothing to count
+    if(cacheAdmit == FS3_ADMIT_ALL || sketch == NULL){
+        return;
+    }
+
+    for(int row = 0; row < FS3_SKETCH_ROWS; row++){
+        uint8_t *counter = sketch + fs3_sketch_slot(row, trk, sct);
+        if(*counter < FS3_SKETCH_MAX){
+            (*counter)++;
+        }
+    }
+
+    // Age the sketch
+    if(++sketchUses >= 10 * cacheSize){
+        for(uint32_t i = 0; i < FS3_SKETCH_ROWS * (sketchMask + 1); i++){
+            sketch[i] >>= 1;
+        }
+        sketchUses = 0;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_count_use
+// Description  : Counts a use of a track / sector in the frequency sketch and the
+//                miss ratio curve. A put right after a use of the same sector (a
+//                read miss filling the cache, or the write half of a partial
+//                sector write) is the same use and is not counted again.
+//
+// Inputs       : trk - the track number of the sector
+//                sct - the sector number of the sector
+//                put - 1 for a put, 0 for a get
+// Outputs      : none
+
+void fs3_count_use(FS3TrackIndex trk, FS3SectorIndex sct, int8_t put){
+
+    // Local variables
+    int32_t key = trk * FS3_TRACK_SIZE + sct;
+
+    if(put && lastUseKey == key){
+        return;
+    }
+    lastUseKey = key;
+
+    fs3_sketch_add(trk, sct);
+    fs3_mrc_access(trk, sct, !put);
+    cacheUses++;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_sketch_estimate
+// Description  : Estimates the recent uses of a track / sector, the smallest of
+//                its counters
+//
+// Inputs       : trk - the track number of the sector
+//                sct - the sector number of the sector
+// Outputs      : estimated number of uses
+
+int fs3_sketch_estimate(FS3TrackIndex trk, FS3SectorIndex sct){
+
+    // Local variables
+    int estimate = FS3_SKETCH_MAX;
+
+    for(int row = 0; row < FS3_SKETCH_ROWS; row++){
+        int count = sketch[fs3_sketch_slot(row, trk, sct)];
+        if(count < estimate){
+            estimate = count;
+        }
+    }
+
+    return(estimate);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_admit
+// Description  : Asks the admission filter whether a clean sector that missed is
+//                worth a cache line. While there are free lines everything is.
+//
+// Inputs       : trk - the track number of the sector
+//                sct - the sector number of the sector
+// Outputs      : 1 to cache the sector, 0 to leave it out
+
+int fs3_admit(FS3TrackIndex trk, FS3SectorIndex sct){
+
+    // Local variables
+    int32_t victim;
+
+    // Only a full cache has anything to protect
+    if(cacheAdmit == FS3_ADMIT_ALL || freeLine != -1 || cacheItems < cacheSize){
+        return(1);
+    }
+
+    switch(cacheAdmit){
+    case FS3_ADMIT_SECOND:
+        // Seen before, this use included
+        return(fs3_sketch_estimate(trk, sct) >= 2);
+
+    default:
+        // Worth more than what it would replace (ties keep the cached line)
+        victim = cacheWays ? fs3_set_place(trk, sct) : fs3_policy_peek();
+        if(victim == -1 || (cacheWays && cacheTags[victim] == 0)){
+            return(1);
+        }
+        return(fs3_sketch_estimate(trk, sct) >= fs3_sketch_estimate((cache + victim) -> ctrk, (cache + victim) -> csec));
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_set_cache_admission
+// Description  : Select the admission filter for clean sectors that miss, the
+//                frequency sketch is sized at the next fs3_init_cache
+//
+// Inputs       : admit - the admission filter
+// Outputs      : 0 if successful, -1 if failure
+
+int fs3_set_cache_admission(FS3CacheAdmit admit) {
+
+    // Failure condition
+    if(admit < FS3_ADMIT_ALL || admit > FS3_ADMIT_TINYLFU){
+        logMessage(LOG_INFO_LEVEL, "Unknown cache admission filter [%d].", admit);
+        return(-1);
+    }
+
+    cacheAdmit = admit;
+    return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_set_cache_policy
+// Description  : Select the replacement policy, takes effect at the next
+//                fs3_init_cache
+//
+// Inputs       : policy - the replacement policy
+// Outputs      : 0 if successful, -1 if failure
+
+int fs3_set_cache_policy(FS3CachePolicy policy) {
+
+    // Failure condition
+    if(policy < FS3_CACHE_LRU || policy > FS3_CACHE_S3FIFO){
+        logMessage(LOG_INFO_LEVEL, "Unknown cache replacement policy [%d].", policy);
+        return(-1);
+    }
+
+    if(cache != NULL){
+        logMessage(LOG_INFO_LEVEL, "Cache replacement policy cannot change while the cache is open.");
+        return(-1);
+    }
+
+    cachePolicy = policy;
+    return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_cache_policy_name
+// Description  : Names the replacement policy in use
+//
+// Inputs       : none
+// Outputs      : the name of the policy
+
+const char * fs3_cache_policy_name(void) {
+    switch(cachePolicy){
+    case FS3_CACHE_CLOCK:  return("CLOCK");
+    case FS3_CACHE_2Q:     return("2Q");
+    case FS3_CACHE_ARC:    return("ARC");
+    case FS3_CACHE_S3FIFO: return("S3-FIFO");
+    default:               return("LRU");
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_set_cache_pages
+// Description  : Select the pages backing the cache data arena, takes effect at
+//                the next fs3_init_cache
+//
+// Inputs       : pages - normal, transparent huge or explicit huge pages
+// Outputs      : 0 if successful, -1 if failure
+
+int fs3_set_cache_pages(FS3CachePages pages) {
+
+    // Failure condition
+    if(pages != FS3_CACHE_PAGES_NORMAL && pages != FS3_CACHE_PAGES_THP && pages != FS3_CACHE_PAGES_HUGETLB){
+        logMessage(LOG_INFO_LEVEL, "Unknown cache page type [%d].", pages);
+        return(-1);
+    }
+
+    cachePages = pages;
+    return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_arena_alloc
+// Description  : Map the page aligned arena holding the data of every cache line,
+//                falling back to normal pages when huge pages are not available
+//
+// Inputs       : cachelines - the number of cache lines to hold
+// Outputs      : 0 if successful, -1 if failure
+
+int fs3_arena_alloc(uint16_t cachelines) {
+
+    // Local variables
+    size_t bytes = (size_t)cachelines * FS3_SECTOR_SIZE;
+    void *arena  = MAP_FAILED;
+
+    cachePagesUsed = cachePages;
+
+#ifdef MAP_HUGETLB
+    // Explicit huge pages come from the reserved pool, whole pages only
+    if(cachePages == FS3_CACHE_PAGES_HUGETLB){
+        size_t hugeBytes = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        arena = mmap(NULL, hugeBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(arena != MAP_FAILED){
+            bytes = hugeBytes;
+        }else{
+            logMessage(LOG_INFO_LEVEL, "No explicit huge pages for the cache, using transparent huge pages.");
+            cachePagesUsed = FS3_CACHE_PAGES_THP;
+        }
+    }
+#else
+    if(cachePages == FS3_CACHE_PAGES_HUGETLB){
+        cachePagesUsed = FS3_CACHE_PAGES_THP;
+    }
+#endif
+
+    // Normal pages (mmap is always page aligned)
+    if(arena == MAP_FAILED){
+        arena = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(arena == MAP_FAILED){
+            logMessage(LOG_INFO_LEVEL, "Mapping a %lu byte cache arena failed.", (unsigned long)bytes);
+            return(-1);
+        }
+
+#ifdef MADV_HUGEPAGE
+        // Ask for transparent huge pages, only a hint
+        if(cachePagesUsed == FS3_CACHE_PAGES_THP && madvise(arena, bytes, MADV_HUGEPAGE) == -1){
+            logMessage(LOG_INFO_LEVEL, "Transparent huge pages not available for the cache.");
+            cachePagesUsed = FS3_CACHE_PAGES_NORMAL;
+        }
+#else
+        cachePagesUsed = FS3_CACHE_PAGES_NORMAL;
+#endif
+    }
+
+    cacheArena      = arena;
+    cacheArenaBytes = bytes;
+    return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_cache_alloc
+// Description  : Allocate an empty cache of a number of lines and its indexes,
+//                organized as cacheWays says
+//
+// Inputs       : cachelines - the number of cache lines to include in cache
+// Outputs      : 0 if successful, -1 if failure
+
+int fs3_cache_alloc(uint16_t cachelines) {
+
+    // Local variables
+    uint32_t buckets = 1;
+
+    // Set-associative caches hold whole sets only
+    if(cacheWays){
+        cachelines -= cachelines % cacheWays;
+    }
+
+    if(cachelines == 0){ // 0 line cache is pointless
+        logMessage(LOG_INFO_LEVEL, "Cache with 0 cache lines NOT created, a 0 line cache is useless");
+        return(-1);
+    }else{       
+        // At least two buckets per line keeps the chains short
+        while(buckets < 2 * (uint32_t)cachelines){
+            buckets <<= 1;
+        }
+
+        //Allocate area for the cache line metadata and its hash index in the heap
+        cache = malloc(sizeof(FS3Cache)*cachelines);
+        cacheHash = malloc(sizeof(int32_t)*buckets);
+        ghosts = malloc(sizeof(FS3Ghost)*(cachelines + 1));
+        ghostHash = malloc(sizeof(int32_t)*buckets);
+        cacheSets = cacheWays ? cachelines / cacheWays : 0;
+        cacheTags = cacheWays ? aligned_alloc(64, (sizeof(uint32_t)*cachelines + 63) / 64 * 64) : NULL;
+        cachePlru = cacheWays ? calloc(cacheSets, sizeof(uint16_t)) : NULL;
+        for(sketchMask = 64; sketchMask < 2 * (uint32_t)cachelines; sketchMask <<= 1); // Two counters per line and row
+        sketch = calloc(FS3_SKETCH_ROWS * sketchMask, sizeof(uint8_t));
+        sketchMask -= 1;
+        sketchUses = 0;
+
+        // Check for success, the line data goes in its own arena
+        if(cache == NULL || cacheHash == NULL || ghosts == NULL || ghostHash == NULL ||
+           sketch == NULL || (cacheWays && (cacheTags == NULL || cachePlru == NULL)) || cacheAllocFault ||
+           fs3_arena_alloc(cachelines) == -1){ // Cache memory not allocated
+            cacheAllocFault = 0;
+            logMessage(LOG_INFO_LEVEL, "Initalization of a %d cache line cache failed, exiting program.", cachelines);
+            free(cache);
+            free(cacheHash);
+            free(ghosts);
+            free(ghostHash);
+            free(cacheTags);
+            free(cachePlru);
+            free(sketch);
+            cache = NULL;
+            cacheHash = NULL;
+            ghosts = NULL;
+            ghostHash = NULL;
+            cacheTags = NULL;
+            cachePlru = NULL;
+            sketch = NULL;
+            return(-1);
+        }else{
+            // Initalize all variables, every line starts on the free list
+            for(int32_t i = 0; i<cachelines; i++){
+                (cache + i) -> csec = -1;        // Set sector to 0
+                (cache + i) -> ctrk = -1;        // Set track to 0
+                (cache + i) -> lastAccess = -1; // Set last access to -1
+                (cache + i) -> dirty = 0;       // Nothing written yet
+                (cache + i) -> cqueue = 0;      // Not on a policy list yet
+                (cache + i) -> cref = 0;        // Not referenced
+                (cache + i) -> cprefetch = 0;   // Not read ahead
+                (cache + i) -> lprev = -1;      // Not on a policy list
+                (cache + i) -> lnext = (i + 1 < cachelines) ? i + 1 : -1; // Next free line
+                (cache + i) -> hnext = -1;      // Not in the hash index
+            }
+            memset(cacheHash, 0xff, sizeof(int32_t)*buckets); // Every bucket empty (-1)
+            if(cacheWays){
+                memset(cacheTags, 0, sizeof(uint32_t)*cachelines); // Every way empty
+            }
+            memset(dirtyHead, 0xff, sizeof(dirtyHead));       // No dirty lines (-1)
+            memset(cacheValid, 0, sizeof(cacheValid));        // Nothing cached
+            cacheHashMask = buckets - 1;
+            qHead[0] = qHead[1] = qTail[0] = qTail[1] = -1;
+            qSize[0] = qSize[1] = 0;
+            freeLine = cacheWays ? -1 : 0; // Set-associative lines are placed by set
+
+            // Every ghost entry starts on the ghost free list
+            for(int32_t g = 0; g <= cachelines; g++){
+                (ghosts + g) -> gnext = (g < cachelines) ? g + 1 : -1;
+            }
+            memset(ghostHash, 0xff, sizeof(int32_t)*buckets); // No ghosts (-1)
+            gHead[0] = gHead[1] = gTail[0] = gTail[1] = -1;
+            gSize[0] = gSize[1] = 0;
+            ghostFree = 0;
+            clockHand = 0;
+            arcTarget = 0;
+            cacheItems = 0;
+            cacheDirty = 0;
+
+            //Log info
+            logMessage(LOG_INFO_LEVEL, "Cache successfully initalized.");
+            logMessage(LOG_INFO_LEVEL, "Cache state [%d items, %d bytes used]", cacheItems, cacheItems*FS3_SECTOR_SIZE);
+            cacheSize = cachelines; // Upate global variable for use elsewhere
+            return(0); // Indicate success
+        }
+    }
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_init_cache
+// Description  : Initialize the cache with a fixed number of cache lines
+//
+// Inputs       : cachelines - the number of cache lines to include in cache
+// Outputs      : 0 if successful, -1 if failure
+
+int fs3_init_cache(uint16_t cachelines) {
+
+    //Failure condition
+    if(cache != NULL || cacheSize != -1){ // Cache is already initalized
+        logMessage(LOG_INFO_LEVEL, "Cache already initalized, exiting program.");
+        return(-1);
+    }
+
+    // Organization asked for since the last init, statistics start over
+    cacheWays = cacheWaysNext;
+    cacheGets = cacheInserts = cacheMisses = cacheHits = cacheRejects = 0;
+    cacheDirtyWrites = cacheFlushes = 0;
+    cachePrefetches = cachePrefetchHits = cachePrefetchWaste = 0;
+    return(fs3_cache_alloc(cachelines));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_cache_lines_for_bytes
+// Description  : Converts a memory budget into cache lines, counting the line
+//                data and the per line bookkeeping (metadata, hash buckets,
+//                ghost entries, sketch counters)
+//
+// Inputs       : bytes - memory the cache may use
+// Outputs      : number of cache lines that fit (at most 65535)
+
+uint16_t fs3_cache_lines_for_bytes(size_t bytes) {
+
+    // Cost of one line
+    size_t perLine = FS3_SECTOR_SIZE + sizeof(FS3Cache) + sizeof(FS3Ghost) + 4 * sizeof(int32_t) + 2 * FS3_SKETCH_ROWS;
+    size_t lines   = bytes / perLine;
+
+    return((lines > UINT16_MAX) ? UINT16_MAX : (uint16_t)lines);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_init_cache_bytes
+// Description  : Initialize the cache with as many lines as fit in a memory budget
+//
+// Inputs       : bytes - memory the cache may use
+// Outputs      : 0 if successful, -1 if failure
+
+int fs3_init_cache_bytes(size_t bytes) {
+    return(fs3_init_cache(fs3_cache_lines_for_bytes(bytes)));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_evict_line
+// Description  : Evicts the line the replacement policy gives up first, writing
+//                it back if it is dirty, and puts it on the free list
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int fs3_evict_line(void) {
+
+    // Local variables
+    int32_t victim;
+
+    // The policy's own choice (set-associative caches keep q0 in recency order)
+    switch(cacheWays ? FS3_CACHE_LRU : cachePolicy){
+    case FS3_CACHE_CLOCK:  victim = fs3_clock_idx();     break;
+    case FS3_CACHE_2Q:     victim = fs3_2q_idx();        break;
+    case FS3_CACHE_ARC:    victim = fs3_arc_replace(0);  break;
+    case FS3_CACHE_S3FIFO: victim = fs3_s3fifo_idx();    break;
+    default:               victim = fs3_lru_idx();       break;
+    }
+    if(victim == -1){
+        return(-1);
+    }
+
+    // Written data reaches the disk first
+    if((cache + victim) -> dirty && fs3_flush_track((cache + victim) -> ctrk, NULL, 0) == -1){
+        return(-1);
+    }
+    if((cache + victim) -> cprefetch){
+        cachePrefetchWaste++;
+    }
+
+    // Back to an unused line
+    fs3_hash_remove(victim);
+    fs3_queue_unlink(victim);
+    (cache + victim) -> ctrk = -1;
+    (cache + victim) -> csec = -1;
+    (cache + victim) -> cref = 0;
+    (cache + victim) -> cprefetch = 0;
+    (cache + victim) -> lnext = freeLine;
+    freeLine = victim;
+    cacheItems--;
+
+    return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_resize_cache
+// Description  : Grow or shrink the cache while it is in use. Shrinking evicts
+//                lines in policy order until the rest fit, then the lines left
+//                move to the new cache, coldest first so the policy lists keep
+//                their order. Ghost history starts over. If a line cannot be
+//                moved, the dirty lines left behind are written back and the
+//                resize fails. If the new cache cannot be allocated the old one
+//                is kept as it was.
+//
+// Inputs       : cachelines - the new number of cache lines
+// Outputs      : 0 if successful, -1 if failure
+
+int fs3_resize_cache(uint16_t cachelines) {
+
+    // Local variables
+    uint16_t lines = cacheWays ? cachelines - cachelines % cacheWays : cachelines;
+    int32_t count  = 0;
+    int32_t oldSize, oldInserts;
+
+    // Failure condition
+    if(cache == NULL || lines == 0){
+        logMessage(LOG_INFO_LEVEL, "Cannot resize the cache to %d lines.", cachelines);
+        return(-1);
+    }
+    if(lines == cacheSize){
+        return(0);
+    }
+
+    // Give up the lines that no longer fit, in the order the policy would
+    while(cacheItems > lines){
+        if(fs3_evict_line() == -1){
+            return(-1);
+        }
+    }
+
+    // Lines that survive, coldest first (list 0 before list 1, tail to head)
+    int32_t *keep = malloc(sizeof(int32_t) * (cacheItems + 1));
+    if(keep == NULL){
+        return(-1);
+    }
+    for(int8_t q = 0; q < 2; q++){
+        for(int32_t i = qTail[q]; i != -1; i = (cache + i) -> lprev){
+            keep[count++] = i;
+        }
+    }
+
+    // Keep the old cache aside while the new one is built
+    FS3Cache *oldCache = cache;
+    char *oldArena     = cacheArena;
+    size_t oldBytes    = cacheArenaBytes;
+    int32_t *oldHash   = cacheHash, *oldGhostHash = ghostHash;
+    FS3Ghost *oldGhosts = ghosts;
+    uint32_t *oldTags  = cacheTags;
+    uint16_t *oldPlru  = cachePlru;
+    uint8_t *oldSketch = sketch;
+    uint32_t oldMask   = sketchMask;
+    int32_t oldSets    = cacheSets, oldSketchUses = sketchUses;
+    FS3CachePages oldPages = cachePagesUsed;
+    int32_t oldItems   = cacheItems, oldDirty = cacheDirty, oldArc = arcTarget;
+    int32_t oldDirtyHead[FS3_MAX_TRACKS];
+    memcpy(oldDirtyHead, dirtyHead, sizeof(dirtyHead));
+    oldSize = cacheSize;
+
+    if(fs3_cache_alloc(lines) == -1){
+        // Put the old cache back
+        cache = oldCache; cacheArena = oldArena; cacheArenaBytes = oldBytes;
+        cacheHash = oldHash; ghostHash = oldGhostHash; ghosts = oldGhosts;
+        cacheTags = oldTags; cachePlru = oldPlru; sketch = oldSketch; sketchMask = oldMask;
+        cacheSets = oldSets; sketchUses = oldSketchUses; cachePagesUsed = oldPages;
+        cacheItems = oldItems; cacheDirty = oldDirty; arcTarget = oldArc; cacheSize = oldSize;
+        memcpy(dirtyHead, oldDirtyHead, sizeof(dirtyHead));
+        free(keep);
+        return(-1);
+    }
+
+    // The new sketch starts empty, keep the old counts instead
+    free(sketch);
+    sketch     = oldSketch;
+    sketchMask = oldMask;
+    sketchUses = oldSketchUses;
+    arcTarget  = (int32_t)((int64_t)oldArc * lines / oldSize);
+
+    // Move the lines over, the insert statistics are not real inserts
+    oldInserts = cacheInserts;
+    int32_t moved;
+    for(moved = 0; moved < count; moved++){
+        FS3Cache *old = oldCache + keep[moved];
+        if(fs3_insert_cache(old -> ctrk, old -> csec, oldArena + (size_t)keep[moved] * FS3_SECTOR_SIZE, old -> dirty) == -1){
+            logMessage(LOG_INFO_LEVEL, "Moving [Trk %d, Sec %d] to the resized cache failed.", old -> ctrk, old -> csec);
+            break;
+        }
+
+        // Same place in the policy as before
+        int32_t idx = fs3_find_line(old -> ctrk, old -> csec);
+        (cache + idx) -> cref       = old -> cref;
+        (cache + idx) -> cprefetch  = old -> cprefetch;
+        (cache + idx) -> lastAccess = old -> lastAccess;
+        if(!cacheWays && (cache + idx) -> cqueue != old -> cqueue){
+            fs3_queue_unlink(idx);
+            fs3_queue_push(idx, old -> cqueue);
+        }
+    }
+    cacheInserts = oldInserts;
+
+    // Dirty lines that did not make it over are written back before their data goes away
+    int8_t failed = (moved < count);
+    for(int32_t k = moved; k < count; k++){
+        FS3Cache *old = oldCache + keep[k];
+        if(old -> dirty && queueSectorDisk(old -> ctrk, old -> csec, oldArena + (size_t)keep[k] * FS3_SECTOR_SIZE, FS3_OP_WRSECT) == -1){
+            break;
+        }
+    }
+    if(failed && waitSectorsDisk() == -1){
+        logMessage(LOG_INFO_LEVEL, "Writing back the dirty lines left out of the resized cache failed.");
+    }
+
+    // Free the old cache
+    free(keep);
+    free(oldCache);
+    free(oldHash);
+    free(oldGhosts);
+    free(oldGhostHash);
+    free(oldTags);
+    free(oldPlru);
+    munmap(oldArena, oldBytes);
+
+    logMessage(LOG_INFO_LEVEL, "Cache resized from %d to %d lines [%d items].", oldSize, cacheSize, cacheItems);
+    return(failed ? -1 : 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_resize_cache_bytes
+// Description  : Grow or shrink the cache to as many lines as fit in a memory budget
+//
+// Inputs       : bytes - memory the cache may use
+// Outputs      : 0 if successful, -1 if failure
+
+int fs3_resize_cache_bytes(size_t bytes) {
+    return(fs3_resize_cache(fs3_cache_lines_for_bytes(bytes)));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_set_cache_autotune
+// Description  : Turns auto sizing on or off. When on, the cache is resized now
+//                and then to the smallest size whose estimated hit ratio is
+//                within "withinPct" points of the best one up to maxLines.
+//
+// Inputs       : enable - 1 to auto size, 0 not to
+//                withinPct - hit ratio points the cache may give up for being smaller
+//                maxLines - largest size to pick, in lines
+// Outputs      : 0 if successful, -1 if failure
+
+int fs3_set_cache_autotune(uint8_t enable, double withinPct, uint16_t maxLines) {
+
+    // Failure condition
+    if(enable && (withinPct < 0.0 || withinPct > 100.0 || maxLines < FS3_AUTOTUNE_MIN_LINES)){
+        logMessage(LOG_INFO_LEVEL, "Bad cache auto sizing [%.1f%%, %d lines].", withinPct, maxLines);
+        return(-1);
+    }
+
+    cacheAutoTune = enable ? 1 : 0;
+    cacheAutoPct  = withinPct;
+    cacheAutoMax  = maxLines;
+    cacheAutoLast = cacheUses;
+    return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_cache_autotune
+// Description  : Auto sizing, run between operations. Every FS3_AUTOTUNE_PERIOD
+//                uses it reads the best size off the miss ratio curve and
+//                resizes the cache when that is more than an eighth away.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int fs3_cache_autotune(void) {
+
+    // Local variables
+    int32_t want;
+
+    // Not yet
+    if(!cacheAutoTune || cache == NULL || cacheUses - cacheAutoLast < FS3_AUTOTUNE_PERIOD){
+        return(0);
+    }
+    cacheAutoLast = cacheUses;
+
+    // Too few samples to go on
+    want = fs3_mrc_best_size(cacheAutoPct, cacheAutoMax);
+    if(want == -1){
+        return(0);
+    }
+    if(want < FS3_AUTOTUNE_MIN_LINES){
+        want = FS3_AUTOTUNE_MIN_LINES;
+    }
+
+    // Small changes are not worth moving the cache for
+    if(abs(want - cacheSize) <= cacheSize / 8){
+        return(0);
+    }
+
+    logMessage(LOG_INFO_LEVEL, "Auto sizing the cache from %d to %d lines [%.2f%% estimated hits].", cacheSize, want, fs3_mrc_hit_ratio(want));
+    cacheAutoResizes++;
+    return(fs3_resize_cache(want));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_close_cache
+// Description  : Close the cache, freeing any buffers held in it
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int fs3_close_cache(void)  {
+
+    // Failure condition
+    if(cache == NULL || cacheSize == -1){ // Cache not initalized
+        logMessage(LOG_INFO_LEVEL, "Cache was never inilaized, cannot close. Exiting program.");
+        return(-1);
+    }
+
+    // Nothing written may be lost (normally unmount already flushed everything)
+    if(cacheDirty > 0 && fs3_flush_cache(NULL, 0) == -1){
+        logMessage(LOG_INFO_LEVEL, "Failed to flush %d dirty cache lines on close.", cacheDirty);
+        return(-1);
+    }
+
+    for(int32_t i = 0; i<cacheSize; i++){
+        // Reset all cache values
+        (cache + i) -> csec       =  0; // Set sector to 0
+        (cache + i) -> ctrk       =  0; // Set track to 0
+        (cache + i) -> lastAccess = -1; // Set last access to -1
+    }
+
+    // Reset
+    cacheSize  = -1; // Update global variable
+    cacheItems = 0;  // Reset cache item
+    qHead[0] = qHead[1] = qTail[0] = qTail[1] = freeLine = -1;
+    qSize[0] = qSize[1] = 0;
+
+    // Free cache and index pointers, unmap the line data
+    free(cache);
+    free(cacheHash);
+    free(ghosts);
+    free(ghostHash);
+    free(cacheTags);
+    free(cachePlru);
+    free(sketch);
+    munmap(cacheArena, cacheArenaBytes);
+
+    // Reset pointers
+    cache = NULL;
+    cacheHash = NULL;
+    ghosts = NULL;
+    ghostHash = NULL;
+    cacheTags = NULL;
+    cachePlru = NULL;
+    sketch = NULL;
+    cacheArena = NULL;
+    cacheArenaBytes = 0;
+
+    //Log info
+    logMessage(LOG_INFO_LEVEL, "Cache successfully un-initalized.");
+    logMessage(LOG_INFO_LEVEL, "Cache state [%d items, %d bytes used]", cacheItems, cacheItems*FS3_SECTOR_SIZE);
+    return(0); // Indicate success
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_insert_cache
+// Description  : Put an element in the cache, clean or dirty, writing back the
+//                line it replaces if that one is dirty
+//
+// Inputs       : trk - the track number of the sector to put in cache
+//                sct - the sector number of the sector to put in cache
+//                buf - the sector data
+//                dirty - 1 if the data is not on the disk yet, 0 if it is
+// Outputs      : 0 if inserted, -1 if not inserted
+
+int fs3_insert_cache(FS3TrackIndex trk, FS3SectorIndex sct, void *buf, int8_t dirty) {
+
+    // Local variables
+    int32_t idx;
+
+    // Failure condition
+    if(cache == NULL){
+        // If the cache was never allocated in the heap
+        logMessage(LOG_INFO_LEVEL, "Cache never allocated, cannot put cache line into cache.");
+        return(-1);
+    }
+
+    // Check to see if track / sector data is already in the cache
+    idx = fs3_find_line(trk, sct);
+    if(idx != -1){
+
+        // Track & sector found -> Update line data
+        memcpy(LINE_DATA(idx), buf, FS3_SECTOR_SIZE); // Update line data
+        fs3_set_dirty(idx, dirty);
+
+        // Read ahead data overwritten before anyone read it
+        if((cache + idx) -> cprefetch){
+            (cache + idx) -> cprefetch = 0;
+            cachePrefetchWaste++;
+        }
+
+        // Tell the replacement policy
+        fs3_policy_hit(idx);
+        cacheInserts++;
+
+        // Log info
+        logMessage(LOG_INFO_LEVEL, "[Trk %d, Sec %d] found in cache, overwriting data buffer", trk, sct);
+
+        // Indicate success
+        return(0);
+    }
+
+    // Trk / Sct not found, the policy decides which list it joins and which line it takes
+    // (set-associative caches pick a way of the sector's set instead)
+    int8_t queue = 0;
+    int32_t victim = cacheWays ? fs3_set_place(trk, sct) : fs3_policy_place(trk, sct, &queue);
+
+    // Fill all unused cache lines first
+    if(victim != -1 && cacheWays && cacheTags[victim] == 0){
+        idx = victim;
+        cacheItems++;
+
+        // Log info
+        logMessage(LOG_INFO_LEVEL, "[Trk %d, Sec %d] placed in an empty way.[Cold Miss]", trk, sct);
+    }else if(victim == -1 && freeLine != -1){
+        idx = freeLine;
+        freeLine = (cache + idx) -> lnext;
+        cacheItems++;
+
+        // Log info
+        logMessage(LOG_INFO_LEVEL, "[Trk %d, Sec %d] replaced cache line with last access of -1.[Cold Miss]", trk, sct);
+    }else{
+
+        // Will only run if all cache lines are already filled
+        if(victim == -1){
+
+            // Log failure
+            logMessage(LOG_INFO_LEVEL, "Could not find a line to replace (victim == -1)");
+            return(-1);
+        }
+
+        // The line being replaced has to reach the disk first, along with the other
+        // dirty lines on its track while the controller is there anyway
+        if((cache + victim) -> dirty && fs3_flush_track((cache + victim) -> ctrk, NULL, 0) == -1){
+            return(-1);
+        }
+
+        // Take the line away from its old sector, read ahead data nobody used was wasted
+        idx = victim;
+        if((cache + idx) -> cprefetch){
+            (cache + idx) -> cprefetch = 0;
+            cachePrefetchWaste++;
+        }
+        fs3_hash_remove(idx);
+        fs3_queue_unlink(idx);
+
+        // Log info
+        logMessage(LOG_INFO_LEVEL, "[Trk %d, Sec %d] replaced cache line %d (%s).", trk, sct, idx, fs3_cache_policy_name());
+    }
+
+    // Set cache variables
+    (cache + idx) -> csec = sct;                            // Set sector to sct
+    (cache + idx) -> ctrk = trk;                            // Set track to trk
+    (cache + idx) -> cref = 0;                              // Not referenced since it came in
+    (cache + idx) -> lastAccess = nextAccess;               // Update access time
+    nextAccess++;
+    memcpy(LINE_DATA(idx), buf, FS3_SECTOR_SIZE);           // Update line data
+    fs3_hash_add(idx);
+    fs3_queue_push(idx, queue);
+    fs3_set_dirty(idx, dirty);                              // Set dirty state
+    if(cacheWays){
+        fs3_plru_touch(idx);
+    }
+
+    // Update
+    cacheInserts++;
+
+    // Log info
+    logMessage(LOG_INFO_LEVEL, "[Trk %d, Sec %d] placed in cache.", trk, sct);
+    logMessage(LOG_INFO_LEVEL, "Cache state [%d items, %d bytes used]", cacheItems, cacheItems*FS3_SECTOR_SIZE);
+    return(0); // Indicate success / Exit from function
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_put_cache
+// Description  : Put an element in the cache, unless it is not cached yet and
+//                the admission filter turns it away
+//
+// Inputs       : trk - the track number of the sector to put in cache
+//                sct - the sector number of the sector to put in cache
+//                buf - the sector data
+// Outputs      : 0 if inserted (or turned away), -1 if not inserted
+
+int fs3_put_cache(FS3TrackIndex trk, FS3SectorIndex sct, void *buf) {
+
+    // Count the use (unless the get before it did), then let the admission filter keep one-shot sectors out
+    fs3_count_use(trk, sct, 1);
+    if(cache != NULL && fs3_find_line(trk, sct) == -1 && !fs3_admit(trk, sct)){
+        cacheRejects++;
+        logMessage(LOG_INFO_LEVEL, "[Trk %d, Sec %d] not admitted to the cache.", trk, sct);
+        return(0);
+    }
+
+    return(fs3_insert_cache(trk, sct, buf, 0));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_write_cache
+// Description  : Put a written element in the cache, it stays dirty until it is
+//                flushed (write-back)
+//
+// Inputs       : trk - the track number of the sector to put in cache
+//                sct - the sector number of the sector to put in cache
+//                buf - the sector data
+// Outputs      : 0 if inserted, -1 if not inserted
+
+int fs3_write_cache(FS3TrackIndex trk, FS3SectorIndex sct, void *buf) {
+
+    // Dirty data has nowhere else to go, it is always admitted
+    fs3_count_use(trk, sct, 1);
+    cacheDirtyWrites++;
+    return(fs3_insert_cache(trk, sct, buf, 1));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_get_cache
+// Description  : Get an element from the cache 
+//
+// Inputs       : trk - the track number of the sector to find
+//                sct - the sector number of the sector to find
+// Outputs      : returns NULL if not found or failed, pointer to buffer if found
+
+void * fs3_get_cache(FS3TrackIndex trk, FS3SectorIndex sct)  {
+
+    // Local variables
+    int32_t idx;
+
+    // Increment how many times get has been called
+    cacheGets++;
+
+    // Failure condition
+    if(cache == NULL){
+        // If the cache was never allocated in the heap
+        logMessage(LOG_INFO_LEVEL, "Cache never allocated, cannot put cache line into cache.");
+        return(NULL);
+    }
+
+    // Check to see if track / sector data is already in the cache
+    idx = fs3_find_line(trk, sct);
+    if(idx != -1){
+
+        // Track & sector found: Tell the replacement policy
+        fs3_policy_hit(idx);
+
+        // Update
+        cacheHits++;
+        fs3_count_use(trk, sct, 0);
+        if((cache + idx) -> cprefetch){
+            (cache + idx) -> cprefetch = 0;
+            cachePrefetchHits++;
+        }
+
+        // Log info
+        logMessage(LOG_INFO_LEVEL, "[Trk %d, Sec %d] found in cache. Cache hits = %d", trk, sct, cacheHits);
+
+        // Indicate success
+        return(LINE_DATA(idx));
+    }
+
+    // Cache not found, return null / upate cache misses (the miss is a use too)
+    cacheMisses++;
+    fs3_count_use(trk, sct, 0);
+    logMessage(LOG_INFO_LEVEL, "[Trk %d, Sec %d] not found in cache. Cache misses = %d", trk, sct, cacheMisses);
+    return(NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
 //
-// Implementation
+// Function     : fs3_probe_cache
+// Description  : Tells whether an element is in the cache, without counting a
+//                get or changing its place in the replacement policy
+//
+// Inputs       : trk - the track number of the sector to find
+//                sct - the sector number of the sector to find
+// Outputs      : 1 if cached, 0 if not
+
+int fs3_probe_cache(FS3TrackIndex trk, FS3SectorIndex sct) {
+    return(cache != NULL && (cacheValid[trk][sct / VALID_WORD_BITS] >> (sct % VALID_WORD_BITS) & 1));
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : fs3_init_cache
-// Description  : Returns the least reacently used cache line index
+// Function     : fs3_cache_valid
+// Description  : Returns the word of the validity bitmap holding a sector, the
+//                cached sectors among the 64 aligned sectors around it
 //
-// Inputs       : cachelines - the number of cache lines to include in cache
-// Outputs      : Least Recently Used Index if successful, -1 if failure
+// Inputs       : trk - the track number of the sectors
+//                sct - any sector of the word
+// Outputs      : bit n set if sector (sct & ~63) + n is cached
 
-int16_t fs3_lru_idx(int16_t cachelines){ // lastAccess will never be -1
+uint64_t fs3_cache_valid(FS3TrackIndex trk, FS3SectorIndex sct) {
+    return((cache == NULL) ? 0 : cacheValid[trk][sct / VALID_WORD_BITS]);
+}
 
-    // Local variables
-    int32_t smallestAccess = nextAccess; // The first iteration will always be smaller than nextAccess
-    int16_t LRUidx = -1;
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_prefetch_cache
+// Description  : Put an element read ahead of the reader (or filled in with its
+//                group) in the cache, marked so its first get counts as a
+//                prefetch hit
+//
+// Inputs       : trk - the track number of the sector to put in cache
+//                sct - the sector number of the sector to put in cache
+//                buf - the sector data
+// Outputs      : 0 if inserted, -1 if not inserted
 
-    // Loop over every cache line
-    for(int i = 0; i < cachelines; i++){
-        
-        // If the lastAccess at cache line "i" is smaller than the smallest index
-        if( ((cache + i) -> lastAccess) < smallestAccess){ 
-            
-            //Update smallestIDX
-            smallestAccess = (cache + i) -> lastAccess;
-            LRUidx = i;
-        }
+int fs3_prefetch_cache(FS3TrackIndex trk, FS3SectorIndex sct, void *buf) {
+
+    if(fs3_insert_cache(trk, sct, buf, 0) == -1){
+        return(-1);
     }
 
-    logMessage(LOG_INFO_LEVEL, "LRU idx = %d", LRUidx);
-    return(LRUidx);
+    (cache + fs3_find_line(trk, sct)) -> cprefetch = 1;
+    cachePrefetches++;
+    return(0);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : fs3_init_cache
-// Description  : Initialize the cache with a fixed number of cache lines
+// Function     : fs3_cache_lines
+// Description  : Tells how many lines the cache has
 //
-// Inputs       : cachelines - the number of cache lines to include in cache
+// Inputs       : none
+// Outputs      : number of cache lines, 0 if there is no cache
+
+int32_t fs3_cache_lines(void) {
+    return((cache == NULL) ? 0 : cacheSize);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_set_cache_writeback
+// Description  : Select write-back or write-through and the dirty ratio 
+//                watermarks of the background flusher
+//
+// Inputs       : enable - 1 for write-back, 0 for write-through
+//                lowPct - percent of lines the flusher leaves dirty
+//                highPct - percent of lines dirty that starts the flusher
 // Outputs      : 0 if successful, -1 if failure
 
-int fs3_init_cache(uint16_t cachelines) {
+int fs3_set_cache_writeback(uint8_t enable, uint8_t lowPct, uint8_t highPct) {
 
-    //Failure condition
-    if(cache != NULL || cacheSize != -1){ // Cache is already initalized
-        logMessage(LOG_INFO_LEVEL, "Cache already initalized, exiting program.");
+    // Failure condition
+    if(lowPct > highPct || highPct > 100){
+        logMessage(LOG_INFO_LEVEL, "Bad dirty watermarks [%d%%, %d%%].", lowPct, highPct);
         return(-1);
     }
 
-    if(cachelines == 0){ // 0 line cache is pointless
-        logMessage(LOG_INFO_LEVEL, "Cache with 0 cache lines NOT created, a 0 line cache is useless");
+    // Dirty lines have to go out before writes go straight to the disk again
+    if(!enable && cacheDirty > 0 && fs3_flush_cache(NULL, 0) == -1){
         return(-1);
-    }else{       
-        //Allocate area for the cache in the heap
-        cache = malloc(sizeof(FS3Cache)*cachelines);
-
-        // Check for success
-        if(cache == NULL){ // Cache memory not allocated
-            logMessage(LOG_INFO_LEVEL, "Initalization of a %d cache line cache failed, exiting program.", cachelines);
-            return(-1);
-        }else{
-            // Initalize all variables
-            for(int i = 0; i<cachelines; i++){
-                (cache + i) -> csec = -1;        // Set sector to 0
-                (cache + i) -> ctrk = -1;        // Set track to 0
-                (cache + i) -> lastAccess = -1; // Set last access to -1
-                (cache + i) -> dataBuf = NULL;  // Initalize dataBuf
-            }
-
-            //Log info
-            logMessage(LOG_INFO_LEVEL, "Cache successfully initalized.");
-            logMessage(LOG_INFO_LEVEL, "Cache state [%d items, %d bytes used]", cacheItems, cacheItems*FS3_SECTOR_SIZE);
-            cacheSize = cachelines; // Upate global variable for use elsewhere
-            return(0); // Indicate success
-        }
     }
 
+    cacheWriteBack = enable ? 1 : 0;
+    dirtyLowPct    = lowPct;
+    dirtyHighPct   = highPct;
+    return(0);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : fs3_close_cache
-// Description  : Close the cache, freeing any buffers held in it
+// Function     : fs3_cache_is_writeback
+// Description  : Tells whether writes stay in the cache until flushed
 //
 // Inputs       : none
-// Outputs      : 0 if successful, -1 if failure
+// Outputs      : 1 if write-back, 0 if write-through
 
-int fs3_close_cache(void)  {
+int fs3_cache_is_writeback(void) {
+    return(cacheWriteBack);
+}
 
-    // Failure condition
-    if(cache == NULL || cacheSize == -1){ // Cache not initalized
-        logMessage(LOG_INFO_LEVEL, "Cache was never inilaized, cannot close. Exiting program.");
-        return(-1);
-    }
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_cmp_track
+// Description  : qsort comparator, orders cache line indexes by track then sector,
+//                starting from the track the controller is on and wrapping around
+//
+// Inputs       : a, b - pointers to the cache line indexes
+// Outputs      : <0, 0, >0 like strcmp
 
-    for(int i = 0; i<cacheSize; i++){
-        // Reset all cache values
-        (cache + i) -> csec       =  0; // Set sector to 0
-        (cache + i) -> ctrk       =  0; // Set track to 0
-        (cache + i) -> lastAccess = -1; // Set last access to -1
+int fs3_cmp_track(const void *a, const void *b) {
+    FS3Cache *la = cache + *(const int32_t *)a;
+    FS3Cache *lb = cache + *(const int32_t *)b;
+    int16_t cur  = (currentTrack() < 0) ? 0 : currentTrack();
 
-        if( (cache + i) -> dataBuf != NULL){
-            free((cache + i) -> dataBuf);   // Free dataBuf if its still allocated
-        }
+    // Distance forward from the current track
+    int16_t da = (la -> ctrk - cur + FS3_MAX_TRACKS) % FS3_MAX_TRACKS;
+    int16_t db = (lb -> ctrk - cur + FS3_MAX_TRACKS) % FS3_MAX_TRACKS;
+
+    if(da != db){
+        return(da - db);
     }
+    return(la -> csec - lb -> csec);
+}
 
-    // Reset
-    cacheSize  = -1; // Update global variable
-    cacheItems = 0;  // Reset cache item
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_flush_line
+// Description  : Write one dirty cache line to the disk, it is clean afterwards
+//
+// Inputs       : idx - the cache line
+// Outputs      : 0 if successful, -1 if failure
 
-    // Free cache pointer
-    free(cache);
+int fs3_flush_line(int32_t idx) {
+    FS3Cache *line = cache + idx;
 
-    // Reset pointer
-    cache = NULL;
+    if(writeSectorDisk(line -> ctrk, line -> csec, LINE_DATA(idx)) == -1){
+        logMessage(LOG_INFO_LEVEL, "Flush of [Trk %d, Sec %d] failed.", line -> ctrk, line -> csec);
+        return(-1);
+    }
+    fs3_set_dirty(idx, 0);
+    cacheFlushes++;
 
-    //Log info
-    logMessage(LOG_INFO_LEVEL, "Cache successfully un-initalized.");
-    logMessage(LOG_INFO_LEVEL, "Cache state [%d items, %d bytes used]", cacheItems, cacheItems*FS3_SECTOR_SIZE);
-    return(0); // Indicate success
+    return(0);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : fs3_put_cache
-// Description  : Put an element in the cache
+// Function     : fs3_flush_batch
+// Description  : Write a set of dirty cache lines to the disk as one pipeline
+//                batch, waiting once for all of them. They are clean afterwards.
 //
-// Inputs       : trk - the track number of the sector to put in cache
-//                sct - the sector number of the sector to put in cache
-// Outputs      : 0 if inserted, -1 if not inserted
+// Inputs       : lines - indexes of the cache lines, in the order to write them
+//                count - number of lines
+// Outputs      : 0 if successful, -1 if failure
 
-int fs3_put_cache(FS3TrackIndex trk, FS3SectorIndex sct, void *buf) {
+int fs3_flush_batch(int32_t *lines, int32_t count) {
 
-    // Failure condition
-    if(cache == NULL){
-        // If the cache was never allocated in the heap
-        logMessage(LOG_INFO_LEVEL, "Cache never allocated, cannot put cache line into cache.");
-        return(-1);
+    for(int32_t i = 0; i < count; i++){
+        FS3Cache *line = cache + lines[i];
+        if(queueSectorDisk(line -> ctrk, line -> csec, LINE_DATA(lines[i]), FS3_OP_WRSECT) == -1){
+            return(-1);
+        }
     }
 
-    // Check to see if track / sector data is already in the cache
-    for(int i = 0; i < cacheSize; i++){
-        // Walk the cache looking for the track / sector data
-        if( (cache + i) -> ctrk == trk && (cache+ i) -> csec == sct){
+    // Lines stay dirty unless the whole batch made it
+    if(waitSectorsDisk() == -1){
+        logMessage(LOG_INFO_LEVEL, "Flush of %d cache lines failed.", count);
+        return(-1);
+    }
+    for(int32_t i = 0; i < count; i++){
+        fs3_set_dirty(lines[i], 0);
+        cacheFlushes++;
+    }
 
-            // Track & sector found -> Update dataBuf
-            memcpy((cache + i) -> dataBuf, buf, FS3_SECTOR_SIZE); // Update dataBuf
+    return(0);
+}
 
-            // Update access time 
-            (cache + i) -> lastAccess = nextAccess;
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_flush_lines
+// Description  : Write a set of dirty cache lines to the disk, sorted by track 
+//                so each track is seeked to once
+//
+// Inputs       : lines - indexes of the cache lines (reordered in place)
+//                count - number of lines
+// Outputs      : 0 if successful, -1 if failure
 
-            // Increment nextAccess / cacheInserts
-            nextAccess++;
-            cacheInserts++;
+int fs3_flush_lines(int32_t *lines, int32_t count) {
 
-            // Log info
-            logMessage(LOG_INFO_LEVEL, "[Trk %d, Sec %d] found in cache, overwriting data buffer", trk, sct);
+    // Local variables
+    int32_t arrivalSeeks = 0, issuedSeeks = trackSeeks();
+    int16_t last = currentTrack();
+    int ret;
 
-            // Indicate success
-            return(0);
+    // Count the batch as it came in (coldest first) for the scheduler statistics
+    for(int32_t i = 0; i < count; i++){
+        if((cache + lines[i]) -> ctrk != last){
+            arrivalSeeks++;
+            last = (cache + lines[i]) -> ctrk;
         }
     }
 
-    // Trk / Sct not found, fill all unused cache lines first(lastAccess == -1)
-    for(int i = 0; i < cacheSize; i++){
-        // If the last access at 'i' is -1 (Initalized but not used), place the sector there
-        if( (cache + i) -> lastAccess == -1 ){ 
-            // Set cache variables
-            (cache + i) -> csec = sct;                            // Set sector to sct
-            (cache + i) -> ctrk = trk;                            // Set track to trk
-            (cache + i) -> lastAccess = nextAccess;               // Set last access to the next free access time 
-            (cache + i) -> dataBuf = malloc(FS3_SECTOR_SIZE);     // Allocate area for the dataBuf
-            memcpy((cache + i) -> dataBuf, buf, FS3_SECTOR_SIZE); // Update dataBuf
+    // Group the writes by track, sweeping up from the current one (C-LOOK)
+    qsort(lines, count, sizeof(int32_t), fs3_cmp_track);
 
-            // Update variables
-            nextAccess++;
-            cacheItems++;
-            cacheInserts++;
+    ret = fs3_flush_batch(lines, count);
+    scheduleBatch(arrivalSeeks, trackSeeks() - issuedSeeks);
+    return(ret);
+}
 
-            // Log info 
-            logMessage(LOG_INFO_LEVEL, "[Trk %d, Sec %d] placed in cache.", trk, sct);
-            logMessage(LOG_INFO_LEVEL, "[Trk %d, Sec %d] replaced cache line with last access of -1.[Cold Miss]", trk, sct);
-            logMessage(LOG_INFO_LEVEL, "Cache state [%d items, %d bytes used]", cacheItems, cacheItems*FS3_SECTOR_SIZE);
-            return(0); // Indicate success / Exit from function
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_flush_track
+// Description  : Flush the dirty lines of one track that fall inside the given
+//                extents, walking the track's dirty list
+//
+// Inputs       : trk - the track to flush
+//                ext - extents to flush, NULL to flush every dirty line of the track
+//                numext - number of extents
+// Outputs      : 0 if successful, -1 if failure
+
+int fs3_flush_track(FS3TrackIndex trk, FS3Extent *ext, int32_t numext) {
+
+    // Local variables
+    int32_t lines[FS3_TRACK_SIZE];
+    int32_t count = 0;
+
+    for(int32_t i = dirtyHead[trk]; i != -1; i = (cache + i) -> dnext){
+        int8_t inside = (ext == NULL);
+        for(int32_t e = 0; e < numext && !inside; e++){
+            inside = ext[e].etrk == trk && (cache + i) -> csec >= ext[e].esec &&
+                     (cache + i) -> csec < ext[e].esec + ext[e].elen;
+        }
+
+        if(inside){
+            lines[count++] = i;
         }
     }
 
-    // Will only run if all cache lines are already filled (lastAccess != -1)
+    // Write them all at once
+    return(fs3_flush_batch(lines, count));
+}
 
-    // Find the LRU cache index
-    int LRUidx = fs3_lru_idx(cacheSize);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_flush_cache
+// Description  : Flush the dirty lines that fall inside the given extents, one
+//                track at a time starting from the current track
+//
+// Inputs       : ext - extents to flush, NULL to flush every dirty line
+//                numext - number of extents
+// Outputs      : 0 if successful, -1 if failure
 
-    if(LRUidx == -1){
+int fs3_flush_cache(FS3Extent *ext, int32_t numext) {
 
-        // Log failure
-        logMessage(LOG_INFO_LEVEL, "Could not find LRUidx (LRUidx == -1)");
-        return(-1);
+    // Nothing to do
+    if(cache == NULL || cacheDirty == 0){
+        return(0);
     }
 
-    // Update LRU cache line to new parameters
-    (cache + LRUidx) -> ctrk = trk;              // Update track
-    (cache + LRUidx) -> csec = sct;              // Update sector 
-    (cache + LRUidx) -> lastAccess = nextAccess; // Update access time
-
-    // Update dataBuf with new data 
-    memcpy((cache + LRUidx) -> dataBuf, buf, FS3_SECTOR_SIZE); // Update dataBuf
+    // Log info
+    logMessage(LOG_INFO_LEVEL, "Flushing dirty cache lines [%d dirty].", cacheDirty);
 
-    // Update
-    nextAccess++; 
-    cacheInserts++;
+    // Visit each track with dirty lines once, in elevator order
+    uint64_t pending = 0;
+    for(int16_t trk = 0; trk < FS3_MAX_TRACKS; trk++){
+        if(dirtyHead[trk] != -1){
+            pending |= (uint64_t)1 << trk;
+        }
+    }
+    for(int16_t trk = elevatorNext(pending); trk != -1; trk = elevatorNext(pending)){
+        if(fs3_flush_track(trk, ext, numext) == -1){
+            return(-1);
+        }
+        pending &= ~((uint64_t)1 << trk);
+    }
 
-    // Log info / Update nextAccess
-    logMessage(LOG_INFO_LEVEL, "[Trk %d, Sec %d] placed in cache.", trk, sct);
-    logMessage(LOG_INFO_LEVEL, "[Trk %d, Sec %d] replaced cache line with least recent access.", trk, sct);
-    return(0); // Indicate success / Exit from function
+    return(0);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : fs3_get_cache
-// Description  : Get an element from the cache 
+// Function     : fs3_flush_cache_watermark
+// Description  : Background flusher, run between operations. Once more than the
+//                high watermark of lines are dirty, flush the least recently
+//                used of them until only the low watermark is left.
 //
-// Inputs       : trk - the track number of the sector to find
-//                sct - the sector number of the sector to find
-// Outputs      : returns NULL if not found or failed, pointer to buffer if found
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
 
-void * fs3_get_cache(FS3TrackIndex trk, FS3SectorIndex sct)  {
-    // Increment how many times get has been called
-    cacheGets++;
+int fs3_flush_cache_watermark(void) {
 
-    // Failure condition
-    if(cache == NULL){
-        // If the cache was never allocated in the heap
-        logMessage(LOG_INFO_LEVEL, "Cache never allocated, cannot put cache line into cache.");
-        return(NULL);
+    // Only wake up above the high watermark
+    if(!cacheWriteBack || cache == NULL || cacheDirty * 100 <= cacheSize * dirtyHighPct){
+        return(0);
     }
 
-    // Check to see if track / sector data is already in the cache
-    for(int i = 0; i < cacheSize; i++){
+    // Local variables
+    int32_t keep  = (cacheSize * dirtyLowPct) / 100;
+    int32_t want  = cacheDirty - keep;
+    int32_t count = 0;
+    int32_t lines[want];
 
-        // Walk the cache looking for the track / sector data
-        if( (cache + i) -> ctrk == trk && (cache + i) -> csec == sct){
-            // Track & sector found: Update access time 
-            (cache + i) -> lastAccess = nextAccess;
+    // Collect the coldest dirty lines, walking up from the tails of the policy lists
+    for(int8_t q = 0; q < 2; q++){
+        for(int32_t i = qTail[q]; i != -1 && count < want; i = (cache + i) -> lprev){
+            if((cache + i) -> dirty){
+                lines[count++] = i;
+            }
+        }
+    }
 
-            // Update
-            nextAccess++;
-            cacheHits++;
+    // Flush down to the low watermark
+    logMessage(LOG_INFO_LEVEL, "Dirty lines [%d] above the high watermark, flushing %d.", cacheDirty, count);
+    return(fs3_flush_lines(lines, count));
+}
 
-            // Log info
-            logMessage(LOG_INFO_LEVEL, "[Trk %d, Sec %d] found in cache. Cache hits = %d", trk, sct, cacheHits);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_cache_hit_ratio
+// Description  : Share of gets the cache served since it was initialized
+//
+// Inputs       : none
+// Outputs      : hit ratio in percent (0 before the first get)
 
-            // Indicate success
-            return((cache + i) -> dataBuf);
-        }
+double fs3_cache_hit_ratio(void) {
+    if(cacheHits + cacheMisses == 0){
+        return(0.0);
     }
-
-    // Cache not found, return null / upate cache misses
-    cacheMisses++;
-    logMessage(LOG_INFO_LEVEL, "[Trk %d, Sec %d] not found in cache. Cache misses = %d", trk, sct, cacheMisses);
-    return(NULL);
+    return(100.0 * (double)cacheHits / ((double)cacheHits + (double)cacheMisses));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -304,15 +2194,143 @@ void * fs3_get_cache(FS3TrackIndex trk, FS3SectorIndex sct)  {
 
 int fs3_log_cache_metrics(void) {
     // Calculate the hit ratio
-    float hitRatio = 100.0*((float)cacheHits / ((float)cacheHits + (float)cacheMisses));
+    double hitRatio = fs3_cache_hit_ratio();
 
     // Log block
     logMessage(LOG_OUTPUT_LEVEL, "** FS3 Cache Metrics **");
+    logMessage(LOG_OUTPUT_LEVEL, "Cache Size      [%d lines, %lu bytes of data]", cacheSize, (unsigned long)cacheSize * FS3_SECTOR_SIZE);
     logMessage(LOG_OUTPUT_LEVEL, "Cache Inserts   [%d]", cacheInserts);
     logMessage(LOG_OUTPUT_LEVEL, "Cache Gets      [%d]", cacheGets);
     logMessage(LOG_OUTPUT_LEVEL, "Cache Hits      [%d]", cacheHits);
     logMessage(LOG_OUTPUT_LEVEL, "Cache Misses    [%d]", cacheMisses);
     logMessage(LOG_OUTPUT_LEVEL, "Cache Hit Ratio [%.2f%%]", hitRatio);
+    if(cacheWays){
+        logMessage(LOG_OUTPUT_LEVEL, "Cache Policy    [%d-way set-associative, %d sets, pseudo-LRU]", cacheWays, cacheSets);
+    }else{
+        logMessage(LOG_OUTPUT_LEVEL, "Cache Policy    [%s]", fs3_cache_policy_name());
+    }
+    logMessage(LOG_OUTPUT_LEVEL, "Cache Arena     [%lu bytes, %s pages]", (unsigned long)cacheArenaBytes,
+        (cachePagesUsed == FS3_CACHE_PAGES_HUGETLB) ? "huge" : (cachePagesUsed == FS3_CACHE_PAGES_THP) ? "transparent huge" : "normal");
+    if(cacheAutoTune){
+        logMessage(LOG_OUTPUT_LEVEL, "Cache Autotune  [within %.1f%% of the best, %d resizes]", cacheAutoPct, cacheAutoResizes);
+    }
+    if(cacheAdmit != FS3_ADMIT_ALL){
+        logMessage(LOG_OUTPUT_LEVEL, "Cache Admission [%s, %d rejected]", (cacheAdmit == FS3_ADMIT_SECOND) ? "second touch" : "TinyLFU", cacheRejects);
+    }
+    if(cachePrefetches > 0){
+        logMessage(LOG_OUTPUT_LEVEL, "Cache Prefetch  [%d sectors, %d hits, %d wasted]", cachePrefetches, cachePrefetchHits, cachePrefetchWaste);
+    }
+    if(cacheWriteBack){
+        logMessage(LOG_OUTPUT_LEVEL, "Cache Writes    [%d] (write-back, %d%%-%d%% dirty)", cacheDirtyWrites, dirtyLowPct, dirtyHighPct);
+        logMessage(LOG_OUTPUT_LEVEL, "Cache Flushes   [%d]", cacheFlushes);
+    }
+    fs3_mrc_log_curve();
     
     return(0);
-}
\ No newline at end of file
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_cache_unit_resize
+// Description  : The checks of the cache unit test, on an open 4-way cache of
+//                16 lines
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int fs3_cache_unit_resize(void) {
+
+    // Local variables
+    char buf[FS3_SECTOR_SIZE];
+    int8_t held[64];
+
+    // Fill the cache with clean lines
+    for(FS3SectorIndex sct = 0; sct < 16; sct++){
+        memset(buf, sct, FS3_SECTOR_SIZE);
+        if(fs3_insert_cache(0, sct, buf, 0) == -1){
+            logMessage(LOG_ERROR_LEVEL, "Cache unit test insert of [Trk 0, Sec %d] failed.", sct);
+            return(-1);
+        }
+    }
+    for(FS3SectorIndex sct = 0; sct < 16; sct++){
+        held[sct] = fs3_probe_cache(0, sct);
+    }
+
+    // Growing fails once the new indexes are allocated, the old cache stays
+    cacheAllocFault = 1;
+    if(fs3_resize_cache(64) != -1 || cacheSize != 16 || cacheSets != 4){
+        logMessage(LOG_ERROR_LEVEL, "Cache unit test failed resize left [%d lines, %d sets], expected [16 lines, 4 sets].", cacheSize, cacheSets);
+        return(-1);
+    }
+    for(FS3SectorIndex sct = 0; sct < 16; sct++){
+        char *data = held[sct] ? fs3_get_cache(0, sct) : NULL;
+        if(held[sct] && (data == NULL || data[0] != sct || data[FS3_SECTOR_SIZE - 1] != sct)){
+            logMessage(LOG_ERROR_LEVEL, "Cache unit test lost [Trk 0, Sec %d] in the failed resize.", sct);
+            return(-1);
+        }
+    }
+
+    // New sectors still map to the old sets
+    for(FS3SectorIndex sct = 16; sct < 64; sct++){
+        memset(buf, sct, FS3_SECTOR_SIZE);
+        if(fs3_set_idx(1, sct) >= cacheSets || fs3_insert_cache(1, sct, buf, 0) == -1){
+            logMessage(LOG_ERROR_LEVEL, "Cache unit test insert of [Trk 1, Sec %d] after the failed resize failed.", sct);
+            return(-1);
+        }
+    }
+
+    // The same resize works once the allocation does
+    for(FS3SectorIndex sct = 16; sct < 64; sct++){
+        held[sct] = fs3_probe_cache(1, sct);
+    }
+    if(fs3_resize_cache(64) == -1 || cacheSize != 64 || cacheSets != 16){
+        logMessage(LOG_ERROR_LEVEL, "Cache unit test resize to 64 lines failed.");
+        return(-1);
+    }
+    for(FS3SectorIndex sct = 16; sct < 64; sct++){
+        char *data = held[sct] ? fs3_get_cache(1, sct) : NULL;
+        if(held[sct] && (data == NULL || data[0] != sct)){
+            logMessage(LOG_ERROR_LEVEL, "Cache unit test lost [Trk 1, Sec %d] in the resize.", sct);
+            return(-1);
+        }
+    }
+
+    return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_cache_unit_test
+// Description  : Grows a set-associative cache with the allocation forced to
+//                fail, then checks the old cache still indexes and holds its
+//                lines. Needs no disk, every line is clean.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int fs3_cache_unit_test(void) {
+
+    // Local variables
+    uint8_t ways = cacheWaysNext;
+    int ret;
+
+    if(cache != NULL){
+        logMessage(LOG_ERROR_LEVEL, "Cache unit test needs the cache closed.");
+        return(-1);
+    }
+
+    // A 4-way cache of 4 sets
+    if(fs3_set_cache_ways(4) == -1 || fs3_init_cache(16) == -1){
+        logMessage(LOG_ERROR_LEVEL, "Cache unit test could not create the cache.");
+        fs3_set_cache_ways(ways);
+        return(-1);
+    }
+    ret = fs3_cache_unit_resize();
+
+    // Leave the cache as it was found
+    cacheAllocFault = 0;
+    fs3_close_cache();
+    fs3_set_cache_ways(ways);
+    logMessage(LOG_OUTPUT_LEVEL, "Cache unit test %s.", (ret == 0) ? "passed" : "FAILED");
+    return(ret);
+}
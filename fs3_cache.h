@@ -21,33 +21,260 @@
 
 // Defines
 #define FS3_DEFAULT_CACHE_SIZE 0x8; // 8 cache entries, by default
+#define FS3_DEFAULT_DIRTY_LOW 25   // Percent of lines left dirty by the background flusher (write-back)
+#define FS3_DEFAULT_DIRTY_HIGH 50  // Percent of lines dirty that wakes the background flusher (write-back)
+#define FS3_SKETCH_ROWS 4          // Hash rows of the admission frequency sketch
+#define FS3_SKETCH_MAX 15          // Largest count a sketch counter holds
+#define FS3_AUTOTUNE_PERIOD 4096   // Uses between two auto sizing checks
+#define FS3_AUTOTUNE_MIN_LINES 16  // Smallest cache auto sizing picks
 // 
 // Typedef structures
+
+// Pages backing the cache data arena
+typedef enum {
+    FS3_CACHE_PAGES_NORMAL  = 0, // Normal pages
+    FS3_CACHE_PAGES_THP     = 1, // Transparent huge pages (madvise hint)
+    FS3_CACHE_PAGES_HUGETLB = 2, // Explicit huge pages from the reserved pool
+} FS3CachePages;
+
+// Replacement policies picking the line a miss replaces
+typedef enum {
+    FS3_CACHE_LRU    = 0, // Least recently used
+    FS3_CACHE_CLOCK  = 1, // Second chance, a reference bit per line swept by a clock hand
+    FS3_CACHE_2Q     = 2, // FIFO for first touches, LRU for lines touched again, ghost list of evictions
+    FS3_CACHE_ARC    = 3, // Adaptive replacement, balances recency and frequency with two ghost lists
+    FS3_CACHE_S3FIFO = 4, // Small and main FIFOs with lazy promotion, ghost FIFO of evictions
+} FS3CachePolicy;
+
+// Admission filters deciding whether a clean sector that missed is worth a line
+typedef enum {
+    FS3_ADMIT_ALL     = 0, // Every sector is cached
+    FS3_ADMIT_SECOND  = 1, // Only sectors touched at least twice recently
+    FS3_ADMIT_TINYLFU = 2, // Only sectors used more often than the line they would replace
+} FS3CacheAdmit;
+
+// Cache line metadata, the sector data lives in the cache arena at the line's index
 typedef struct FS3Cache{
-    int16_t csec;      // Keeps track of what sector in the cache 'dataBuf' is in
-    int16_t ctrk;      // Keeps track of what track in the cache 'dataBuf' is in
-    char *dataBuf;      // Sector data being held in the cache
+    int16_t csec;      // Keeps track of what sector the line's data is
+    int16_t ctrk;      // Keeps track of what track the line's data is
     int32_t lastAccess; // Keeps track of the alst time a cache line was used
+    int8_t dirty;       // 1 if the data is newer than the disk (write-back), 0 if not
+    int8_t cqueue;      // Policy list the line is on (0 or 1, meaning depends on the policy)
+    uint8_t cref;       // Reference bit (CLOCK) or access count (S3-FIFO)
+    uint8_t cprefetch;  // 1 if the line was read ahead and not used yet, 0 if not
+    int32_t lprev;      // Next newer line on the policy list, -1 if newest
+    int32_t lnext;      // Next older line on the policy list, -1 if oldest (next free line when unused)
+    int32_t hnext;      // Next line in the same hash bucket, -1 at the end of the chain
+    int32_t dprev;      // Previous dirty line on the same track, -1 at the head
+    int32_t dnext;      // Next dirty line on the same track, -1 at the end
 }FS3Cache;
 
+// Sector the policy evicted recently and still remembers (2Q, ARC, S3-FIFO)
+typedef struct FS3Ghost{
+    int16_t gtrk;       // Track of the evicted sector
+    int16_t gsec;       // Sector of the evicted sector
+    int8_t glist;       // Ghost list the entry is on (0 or 1)
+    int32_t gprev;      // Next newer entry on the list, -1 if newest
+    int32_t gnext;      // Next older entry on the list, -1 if oldest (next free entry when unused)
+    int32_t ghnext;     // Next entry in the same ghost hash bucket, -1 at the end of the chain
+}FS3Ghost;
+
 //
 // Cache Functions
-int16_t fs3_lru_idx(int16_t cachelines);
+uint32_t fs3_hash_idx(FS3TrackIndex trk, FS3SectorIndex sct);
+    // Find the hash bucket of a track / sector
+
+int32_t fs3_find_line(FS3TrackIndex trk, FS3SectorIndex sct);
+    // Find the cache line holding a track / sector (-1 if not cached)
+
+void fs3_hash_remove(int32_t idx);
+    // Take a cache line out of the hash index
+
+void fs3_hash_add(int32_t idx);
+    // Put a cache line into the hash index
+
+int32_t fs3_set_idx(FS3TrackIndex trk, FS3SectorIndex sct);
+    // Find the set a track / sector maps to (set-associative)
+
+int32_t fs3_set_find(FS3TrackIndex trk, FS3SectorIndex sct);
+    // Find the cache line holding a track / sector by comparing the tags of its set
+
+void fs3_plru_touch(int32_t idx);
+    // Point the pseudo-LRU bits of a line's set away from it
+
+int32_t fs3_set_place(FS3TrackIndex trk, FS3SectorIndex sct);
+    // Find the way of its set a track / sector goes in (empty or pseudo-LRU)
+
+int fs3_set_cache_ways(uint8_t ways);
+    // Select a set-associative (ways per set) or fully associative (0) cache, before fs3_init_cache
+
+void fs3_queue_unlink(int32_t idx);
+    // Take a cache line off its policy list
+
+void fs3_queue_push(int32_t idx, int8_t q);
+    // Put a cache line at the newest end of a policy list
+
+void fs3_set_dirty(int32_t idx, int8_t dirty);
+    // Mark a cache line dirty or clean, keeping the per track dirty lists
+
+int32_t fs3_ghost_find(FS3TrackIndex trk, FS3SectorIndex sct);
+    // Find the ghost entry of a recently evicted track / sector (-1 if not remembered)
+
+void fs3_ghost_remove(int32_t g);
+    // Forget a ghost entry
+
+void fs3_ghost_add(int8_t list, FS3TrackIndex trk, FS3SectorIndex sct, int32_t cap);
+    // Remember an evicted track / sector on a ghost list of at most "cap" entries
+
+int32_t fs3_lru_idx(void);
     // Find the lru idx of a cache
 
+int32_t fs3_clock_idx(void);
+    // Sweep the clock hand to the first unreferenced line (CLOCK)
+
+int32_t fs3_2q_idx(void);
+    // Pick the line to replace from A1in or Am (2Q)
+
+int32_t fs3_arc_replace(int8_t inB2);
+    // Evict the LRU of T1 or T2 into its ghost list (ARC)
+
+int32_t fs3_arc_place(FS3TrackIndex trk, FS3SectorIndex sct, int8_t *queue);
+    // Adapt to a miss and pick the line it replaces (ARC)
+
+int32_t fs3_s3fifo_idx(void);
+    // Pick the line to replace from the small or main FIFO (S3-FIFO)
+
+int32_t fs3_policy_place(FS3TrackIndex trk, FS3SectorIndex sct, int8_t *queue);
+    // Find the policy list a missed sector joins and the line it replaces (-1 for a free line)
+
+void fs3_policy_hit(int32_t idx);
+    // Tell the replacement policy a cached line was used again
+
+int32_t fs3_policy_peek(void);
+    // Find the line the replacement policy would most likely replace next, without side effects
+
+uint32_t fs3_sketch_slot(int row, FS3TrackIndex trk, FS3SectorIndex sct);
+    // Find the counter of a track / sector in one row of the frequency sketch
+
+void fs3_sketch_add(FS3TrackIndex trk, FS3SectorIndex sct);
+    // Count a use of a track / sector in the frequency sketch, aging it periodically
+
+void fs3_count_use(FS3TrackIndex trk, FS3SectorIndex sct, int8_t put);
+    // Count a use in the sketch and the miss ratio curve (a put right after a use of it is the same use)
+
+int fs3_sketch_estimate(FS3TrackIndex trk, FS3SectorIndex sct);
+    // Estimate how often a track / sector was used recently
+
+int fs3_admit(FS3TrackIndex trk, FS3SectorIndex sct);
+    // Ask the admission filter whether a missed sector should be cached
+
+int fs3_set_cache_admission(FS3CacheAdmit admit);
+    // Select the admission filter for clean sectors
+
+int fs3_set_cache_policy(FS3CachePolicy policy);
+    // Select the replacement policy (before fs3_init_cache)
+
+const char * fs3_cache_policy_name(void);
+    // Name the replacement policy in use
+
+int fs3_set_cache_pages(FS3CachePages pages);
+    // Select the pages backing the cache data arena (before fs3_init_cache)
+
+int fs3_arena_alloc(uint16_t cachelines);
+    // Map the page aligned arena holding the data of every cache line
+
+int fs3_cache_alloc(uint16_t cachelines);
+    // Allocate an empty cache of a number of lines and its indexes
+
 int fs3_init_cache(uint16_t cachelines);
     // Initialize the cache with a fixed number of cache lines
 
+uint16_t fs3_cache_lines_for_bytes(size_t bytes);
+    // Number of cache lines that fit in a memory budget, bookkeeping included
+
+int fs3_init_cache_bytes(size_t bytes);
+    // Initialize the cache with as many lines as fit in a memory budget
+
+int fs3_evict_line(void);
+    // Evict the line the replacement policy gives up first
+
+int fs3_resize_cache(uint16_t cachelines);
+    // Grow or shrink the cache while it is in use, evicting in policy order
+
+int fs3_resize_cache_bytes(size_t bytes);
+    // Grow or shrink the cache to a memory budget
+
+int fs3_set_cache_autotune(uint8_t enable, double withinPct, uint16_t maxLines);
+    // Turn auto sizing from the miss ratio curve on or off
+
+int fs3_cache_autotune(void);
+    // Resize the cache to the smallest size close to the best hit ratio, now and then
+
 int fs3_close_cache(void);
     // Close the cache, freeing any buffers held in it
 
+int fs3_insert_cache(FS3TrackIndex trk, FS3SectorIndex sct, void *buf, int8_t dirty);
+    // Put a clean or dirty element in the cache, writing back a dirty line it replaces
+
 int fs3_put_cache(FS3TrackIndex trk, FS3SectorIndex sct, void *buf);
     // Put an element in the cache
 
 void * fs3_get_cache(FS3TrackIndex trk, FS3SectorIndex sct);
     // Get an element from the cache (returns NULL if not found)
 
+int fs3_probe_cache(FS3TrackIndex trk, FS3SectorIndex sct);
+    // Tells whether an element is cached, without counting it as a use
+
+uint64_t fs3_cache_valid(FS3TrackIndex trk, FS3SectorIndex sct);
+    // Validity bitmap word of the 64 aligned sectors around a sector (bit set if cached)
+
+int fs3_prefetch_cache(FS3TrackIndex trk, FS3SectorIndex sct, void *buf);
+    // Put an element read ahead of the reader (or filled with its group) in the cache
+
+int32_t fs3_cache_lines(void);
+    // Number of lines in the cache (0 if there is no cache)
+
+int fs3_set_cache_writeback(uint8_t enable, uint8_t lowPct, uint8_t highPct);
+    // Select write-back (1) or write-through (0) and the dirty ratio watermarks
+
+int fs3_cache_is_writeback(void);
+    // Returns 1 if the cache is in write-back mode, 0 if not
+
+int fs3_write_cache(FS3TrackIndex trk, FS3SectorIndex sct, void *buf);
+    // Put a written element in the cache, leaving it dirty until flushed
+
+int fs3_cmp_track(const void *a, const void *b);
+    // qsort comparator, orders cache line indexes by track (from the current one) then sector
+
+int fs3_flush_line(int32_t idx);
+    // Write one dirty cache line to the disk
+
+int fs3_flush_batch(int32_t *lines, int32_t count);
+    // Write a set of dirty cache lines to the disk as one pipeline batch, waiting once
+
+int fs3_flush_lines(int32_t *lines, int32_t count);
+    // Write a set of dirty cache lines to the disk, in track order
+
+int fs3_flush_track(FS3TrackIndex trk, FS3Extent *ext, int32_t numext);
+    // Flush the dirty lines of one track inside the given extents (all if ext is NULL)
+
+int fs3_flush_cache(FS3Extent *ext, int32_t numext);
+    // Flush the dirty lines inside the given extents (all of them if ext is NULL)
+
+int fs3_flush_cache_watermark(void);
+    // Background flusher, flush the coldest dirty lines once the high watermark is passed
+
+double fs3_cache_hit_ratio(void);
+    // Percent of gets served from the cache since it was initialized
+
 int fs3_log_cache_metrics(void);
     // Log the metrics for the cache 
 
+// Unit tests
+int fs3_cache_unit_resize(void);
+    // The checks of the cache unit test, on an open 4-way cache of 16 lines
+
+int fs3_cache_unit_test(void);
+    // Resize failure unit test, the cache must be closed
+
 #endif
\ No newline at end of file
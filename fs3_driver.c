@@ -22,12 +22,18 @@
 #include <fs3_cache.h>
 #include <fs3_common.h>
 #include <fs3_network.h>
+#include <fs3_trace.h>
 
 //
 // Defines
 #define SECTOR_INDEX_NUMBER(x) ((int)(x/FS3_SECTOR_SIZE)) // Gets what sector the bufWrite begins in
 #define MAX_FILES FS3_MAX_TOTAL_FILES   // Max files
 #define MAX_FILE_SIZE 10000000 // 1 MB
+#define EXTENT_INIT_CAP 4      // Number of extents a file starts with room for
+#define SECMAP_INIT_CAP 16     // Number of sectors an open file's sector map starts with room for
+#define FILE_HASH_SIZE 2048    // Buckets in the filename index (power of two, more than MAX_FILES)
+#define FREEMAP_WORD_BITS 64   // Sectors tracked by each word of the free sector bitmap
+#define FREEMAP_WORDS (FS3_TRACK_SIZE/FREEMAP_WORD_BITS) // Bitmap words per track
 
 //
 // Static Global Variables
@@ -42,7 +48,9 @@ uint_fast32_t trkval;  // Updated track value
 
 // Arrays
 char mountState[10] = "unmounted";             // == "mounted" if mounted, "unmounted"if not
-int globalLoc[FS3_MAX_TRACKS][FS3_TRACK_SIZE]; // 0 if not used, 1 if used
+uint64_t freeMap[FS3_MAX_TRACKS][FREEMAP_WORDS]; // Free sector bitmap, bit clear if not used, set if used
+int16_t fileHash[FILE_HASH_SIZE];              // Filename index, ftable index of the name or -1 if empty
+FS3Handle htable[FS3_MAX_TOTAL_FILES + 1];     // Open/permanent file indexes by file handle
 
 // Used to keep track of what file data is next avalible
 int freeOFile  =  0; // Next free open file that can be used
@@ -50,6 +58,26 @@ int freeFile   =  0; // Next free premanant file inxed that can be used (Only us
 int freeHandle =  1; // Next free handle
 int16_t curTrk  = -1; // Current track
 
+// Allocation policy
+FS3AllocPolicy fs3AllocPolicy = FS3_ALLOC_FIRSTFIT;       // How new sectors are placed
+uint16_t fs3AllocWindow       = FS3_DEFAULT_ALLOC_WINDOW; // Sectors reserved for a file at a time (affinity)
+
+// Readahead
+uint16_t fs3ReadAheadMax      = FS3_DEFAULT_READAHEAD;    // Largest readahead window in sectors, 0 disables it
+uint16_t fs3FillGroup         = FS3_DEFAULT_FILL_GROUP;   // Aligned sectors a read miss fills, 1 for the sector alone
+
+// Driver statistics
+int32_t driverSeeks = 0, driverReads = 0, driverWrites = 0; // Controller operations issued
+int32_t driverFills = 0, driverFillSectors = 0;               // Group fills, and the sectors they read
+int64_t driverSeekDistance = 0;                               // Tracks travelled by the seeks
+int32_t schedBatches = 0, schedSeeksSaved = 0;                // Batches that went to the disk, seeks issued below arrival order
+int32_t driverQueued = 0;                                     // Sector operations in the pipeline batch being built
+int32_t driverBatches = 0, driverBatchOps = 0;                // Pipeline batches waited on, and the sector operations in them
+int32_t driverExtents = 0;                                    // Runs of sectors started by file growth, fewer is more contiguous
+
+// Sectors read ahead (or filled) in one pipeline batch are received here
+char driverBatchBuf[FS3_DRIVER_BATCH][FS3_SECTOR_SIZE];
+
 //
 // Implementation
 
@@ -84,7 +112,9 @@ int8_t switchTrack(int16_t trk){
 			return(-1);
 		} 
 
+		driverSeekDistance += (curTrk < 0) ? 0 : abs(trk - curTrk);
 		curTrk = trk; // Update the current track 
+		driverSeeks++;
 		logMessage(FS3DriverLLevel, "Driver successfully changed track to %d", trk);
 		return(0);
 	} else{
@@ -95,796 +125,2297 @@ int8_t switchTrack(int16_t trk){
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : findFreeLoc
-// Description  : returns the file index associated with the next free track / sector
+// Function     : currentTrack
+// Description  : tells which track the controller is on
 //
-// Inputs       : *trkidx - Pointer to the storage variable
-//				: *secidx - Pointer to the storage variable
+// Inputs       : none
+// Outputs      : current track, -1 if none has been selected yet
+
+int16_t currentTrack(void){
+	return(curTrk);
+}
+
+////////////////////////////////////////////////////////////////////////////////
 //
-// Outputs      : 0 if success, -1 if failure
+// Function     : trackSeeks
+// Description  : tells how many track seeks have been sent to the controller
+//
+// Inputs       : none
+// Outputs      : number of seeks issued so far
 
-int8_t findFreeLoc(int16_t *trkidx, int16_t *secidx){
+int32_t trackSeeks(void){
+	return(driverSeeks);
+}
 
-	// Loop through all possible tracks
-	for(int trk=0; trk<FS3_MAX_TRACKS; trk++){
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : nextFreeSec
+// Description  : returns the first free sector at or after "sec" on a track
+//
+// Inputs       : trk - track to search
+//              : sec - first sector to consider
+//
+// Outputs      : index of the free sector, FS3_TRACK_SIZE if there is none
 
-		// Loop through every sector in the track
-		for(int sec=0; sec<FS3_TRACK_SIZE; sec++){
-			
-			// If the track & sector are free(0), set the result
-			if(globalLoc[trk][sec] == 0){
-				
-				*trkidx = trk;
-				*secidx = sec;
-				globalLoc[trk][sec] = 1; // Update global array
-				return(0);
-			}
+int16_t nextFreeSec(int16_t trk, int16_t sec){
+
+	// Walk the words of the track starting with the one holding 'sec'
+	for(int w = sec / FREEMAP_WORD_BITS; w < FREEMAP_WORDS; w++){
+
+		// Free sectors are the clear bits, ignore the ones before 'sec'
+		uint64_t free = ~freeMap[trk][w];
+		if(w == sec / FREEMAP_WORD_BITS){
+			free &= ~0ULL << (sec % FREEMAP_WORD_BITS);
+		}
+
+		if(free != 0){
+			return(w*FREEMAP_WORD_BITS + __builtin_ctzll(free));
 		}
 	}
-	
-	// Log info
-	logMessage(FS3DriverLLevel, "Could not find a free trk/sec, exiting the program");
-	return(-1);
+
+	return(FS3_TRACK_SIZE);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : idxByHandle
-// Description  : returns the file index associated with a file handle
+// Function     : nextUsedSec
+// Description  : returns the first used sector at or after "sec" on a track
 //
-// Inputs       : fd - file handle to find index of 
-//              : *ofidx - Pointer to the storage variable
-//				: *fidx  - Pointer to the storage variable
+// Inputs       : trk - track to search
+//              : sec - first sector to consider
 //
-// Outputs      : 0 if success, -1 if failure
+// Outputs      : index of the used sector, FS3_TRACK_SIZE if there is none
 
-int16_t idxByHandle(int16_t fd, int16_t *ofidx, int16_t *fidx){
-
-	// For every possible file 
-	for(int i=0; i<MAX_FILES; i++){
-		
-		if(oftable[i].ofhandle == fd){ // If the file handle is found at index 'i'
+int16_t nextUsedSec(int16_t trk, int16_t sec){
 
-			*ofidx = i; // Set pointer to ofidx to the open file index
+	// Walk the words of the track starting with the one holding 'sec'
+	for(int w = sec / FREEMAP_WORD_BITS; w < FREEMAP_WORDS; w++){
 
-			// If the open index is found, also return the index of the permanent file
-			for(int j=0; j<MAX_FILES; j++){
-				
-				if(strcmp(oftable[i].ofname, ftable[j].fname) == 0){ // If the names of the files match
+		// Used sectors are the set bits, ignore the ones before 'sec'
+		uint64_t used = freeMap[trk][w];
+		if(w == sec / FREEMAP_WORD_BITS){
+			used &= ~0ULL << (sec % FREEMAP_WORD_BITS);
+		}
 
-					*fidx = j; // Set pointer to fidx to the permanant file index
-					return(0);
-				}		
-			}
+		if(used != 0){
+			return(w*FREEMAP_WORD_BITS + __builtin_ctzll(used));
 		}
 	}
 
-	// Log info
-	logMessage(FS3DriverLLevel, "File/OFile index not found, exiting program");
-	return(-1);
+	return(FS3_TRACK_SIZE);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : construct_fs3_cmdblock
-// Description  : Constructs the command block to communicate with the controller
+// Function     : markSectors
+// Description  : marks a run of sectors on a track as used in the free sector bitmap
 //
-// Inputs       : op - operation code to run
-//              : sec - sector number to operate on
-//              : trk - track number to operate on 
-// Outputs      : retval - the constructed commandblock
+// Inputs       : trk - track of the run
+//              : sec - first sector of the run
+//              : len - number of sectors in the run
+//
+// Outputs      : void
 
-FS3CmdBlk construct_fs3_cmdblock(uint8_t op, uint16_t sec, uint_fast32_t trk, uint8_t ret){
-	
-	// Local Variables for the function
-	FS3CmdBlk tmpop = 0, tmpsec = 0, tmptrk = 0, tmpret = 0, retval = 0; 
-	
-	// Opcode cast and shift
-	tmpop = (FS3CmdBlk)op << 60; // Shifts it to bits 0-3
-	
-	// Sector cast and shift
-	tmpsec = (FS3CmdBlk)sec << 44; // Shifts it to bits 4-19
-	
-	// Track cast and shift
-	tmptrk = (FS3CmdBlk)trk << 12; // Shifts it to bits 20-51
-	
-	// Return cast and shift
-	tmpret = (FS3CmdBlk)ret << 11; // Shifts it to bit 52
-	
-	// Bitwise or all shifter bits together
-	retval = (FS3CmdBlk)(tmpop | tmpsec | tmptrk | tmpret); 
-	
-	return(retval);
+void markSectors(int16_t trk, int16_t sec, int16_t len){
+
+	// Set whole words at a time, masking the partial words at either end
+	while(len > 0){
+		int w     = sec / FREEMAP_WORD_BITS;
+		int bit   = sec % FREEMAP_WORD_BITS;
+		int nbits = (len < FREEMAP_WORD_BITS - bit) ? len : FREEMAP_WORD_BITS - bit;
+
+		freeMap[trk][w] |= ((nbits == FREEMAP_WORD_BITS) ? ~0ULL : ((1ULL << nbits) - 1)) << bit;
+		sec += nbits;
+		len -= nbits;
+	}
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : deconstruct_fs3_cmdblock
-// Description  : Deonstructs the command block to get the changed values from fs3_syscall
+// Function     : unmarkSectors
+// Description  : marks a run of sectors on a track as free in the free sector bitmap
 //
-// Inputs       : *op - pointer to the operation code
-//              : *sec - pointer to the sector number to operate on
-//              : *trk - pointer to the track number to operate on 
-// Outputs      : Void
-
-void deconstruct_fs3_cmdblock(FS3CmdBlk cmdblk, uint8_t *op, uint16_t *sec, uint_fast32_t *trk, uint8_t *ret){
-	
-	// Mask the command block to isolate the opcode 
-	*op = (cmdblk&0xf000000000000000) >> 60; // Set 'op'(&opval) to the least signifigant 4 bits
-
-	// Mask the commandblock to isolate the sector
-	*sec = (cmdblk&0x0fff000000000000) >> 44; // Set 'sec'(&secval) to the least signifigant 16 bits
+// Inputs       : trk - track of the run
+//              : sec - first sector of the run
+//              : len - number of sectors in the run
+//
+// Outputs      : void
 
-	// Mask the commandblock to isolate the track
-	*trk = (cmdblk&0x00001fffffffe000) >> 12; // Set 'trk'(&trkval) to the  least signifigant 32 bits
+void unmarkSectors(int16_t trk, int16_t sec, int16_t len){
 
-	// Mask the commandblock to isolate the return value
-	*ret = (cmdblk&0x0000000000000800) >> 11; // Set 'ret'(&retval) to the least signifigant  8 bits
+	// Clear whole words at a time, masking the partial words at either end
+	while(len > 0){
+		int w     = sec / FREEMAP_WORD_BITS;
+		int bit   = sec % FREEMAP_WORD_BITS;
+		int nbits = (len < FREEMAP_WORD_BITS - bit) ? len : FREEMAP_WORD_BITS - bit;
 
+		freeMap[trk][w] &= ~(((nbits == FREEMAP_WORD_BITS) ? ~0ULL : ((1ULL << nbits) - 1)) << bit);
+		sec += nbits;
+		len -= nbits;
+	}
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : fs3_mount_disk
-// Description  : FS3 interface, mount/initialize filesystem
+// Function     : releaseReservation
+// Description  : gives the unused sectors a file has set aside back to the free
+//                sector bitmap. Where the reservation ended is kept, so the file
+//                still grows from there if nobody took the sectors in between.
 //
-// Inputs       : none
-// Outputs      : 0 if successful, -1 if failure
+// Inputs       : fidx - index of the permanent file
+//
+// Outputs      : void
 
-int32_t fs3_mount_disk(void) {
+void releaseReservation(int16_t fidx){
 
-	// Check to see if file system is already mounted
-	if(strncmp(mountState, "mounted", 7) == 0){
-		logMessage(FS3DriverLLevel, "FS3 DRVR: File system already mounted, exiting program");
-		return(-1); // FS already mounted, end the program
+	// Local variables
+	FS3Extent *resv = &ftable[fidx].fresv;
+
+	if(resv->elen > 0){
+		unmarkSectors(resv->etrk, resv->esec, resv->elen);
+		resv->elen = 0;
 	}
+}
 
-	// Make commandblock telling the controller to mount to the disk
-	FS3CmdBlk retCmd;
-	
-	int netSuccess = network_fs3_syscall(construct_fs3_cmdblock(FS3_OP_MOUNT,0,0,0), &retCmd, NULL);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : findFreeLoc
+// Description  : returns the file index associated with the next free track / sector
+//
+// Inputs       : *trkidx - Pointer to the storage variable
+//				: *secidx - Pointer to the storage variable
+//
+// Outputs      : 0 if success, -1 if failure
 
-	// Deconstructing the fs3_syscall cmdblk to see if it worked
-	deconstruct_fs3_cmdblock(retCmd, &opval, &secval, &trkval, &retval);
+int8_t findFreeLoc(int16_t *trkidx, int16_t *secidx){
 
-	if(retval == 0 && netSuccess == 0){ // Test the output of retval
-		logMessage(FS3DriverLLevel, "FS3 DRVR: mounted.\n");    // Log success
-		memset(ftable,    0x0, sizeof(FS3File)*FS3_MAX_TRACKS); // Initalize ftable to 0
-		memset(oftable,   0x0, sizeof(FS3OpenFile)*MAX_FILES);  // Initalize oftable to 0
-		memset(globalLoc, 0x0, sizeof(globalLoc));              // Initalize globalLoc to 0
-		strcpy(mountState, "mounted");
-		return(0); // Passed
-	}else{
-		logMessage(FS3DriverLLevel, "FS3 DRVR: Systemcall to mount file system failed, exiting program");
-		return(-1); // Failed
+	// A single sector is a run of one
+	if(findFreeRun(1, trkidx, secidx) == -1){
+		return(-1);
 	}
+
+	return(0);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : fs3_unmount_disk
-// Description  : FS3 interface, unmount the disk, close all files
+// Function     : findRunOnTrack
+// Description  : finds the first free run of at least "want" sectors on a track,
+//                otherwise the longest free run on the track
 //
-// Inputs       : none
-// Outputs      : 0 if successful, -1 if failure
+// Inputs       : trk - track to search
+//              : want - number of sectors wanted
+//              : *secidx - Pointer to the storage variable (first sector of the run)
+//
+// Outputs      : full length of the run found, 0 if the track is full
 
-int32_t fs3_unmount_disk(void) {
+int16_t findRunOnTrack(int16_t trk, int16_t want, int16_t *secidx){
 
-	// Check to make sure FS was already mounted
-	if(strncmp(mountState, "mounted", 7) != 0){
-		logMessage(FS3DriverLLevel, "FS3 DRVR: Filesystem not mounted, unable to unmount an unmounted system. Exiting the program");
-		return(-1); // FS is not mounted, bail out
-	}
+	// Local variables
+	int16_t bestSec = -1, bestLen = 0; // Longest run seen so far
+
+	// Hop from each free run of the track to the next
+	int16_t sec = nextFreeSec(trk, 0);
+	while(sec < FS3_TRACK_SIZE){
+		int16_t end = nextUsedSec(trk, sec);
+		int16_t len = end - sec;
+
+		// Take the first run that is long enough
+		if(len >= want){
+			*secidx = sec;
+			return(len);
+		}
 
-	// Cleaning up internal data structure
-	for(int i = 0; i < freeHandle; i++){
-		if(oftable[i].ofhandle != -1){
-			fs3_close(oftable[i].ofhandle); // Close the respective file handle
+		// Remember the longest run in case none is long enough
+		if(len > bestLen){
+			bestSec = sec;
+			bestLen = len;
 		}
+
+		sec = (end < FS3_TRACK_SIZE) ? nextFreeSec(trk, end) : FS3_TRACK_SIZE;
 	}
-	
-	// Local variable
-	FS3CmdBlk retCmd;
 
-	// Make commandblock telling the controller to unmount from the disk
-	int netSuccess = network_fs3_syscall(construct_fs3_cmdblock(FS3_OP_UMOUNT,0,0,0), &retCmd, NULL);
+	*secidx = bestSec;
+	return(bestLen);
+}
 
-	// Deconsteruction
-	deconstruct_fs3_cmdblock(retCmd, &opval, &secval, &trkval, &retval);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : findFreeRun
+// Description  : allocates a run of up to "want" physically contiguous free sectors.
+//                The first run long enough is used, otherwise the longest run found.
+//
+// Inputs       : want - number of sectors wanted
+//              : *trkidx - Pointer to the storage variable (track of the run)
+//				: *secidx - Pointer to the storage variable (first sector of the run)
+//
+// Outputs      : number of sectors allocated if success, -1 if failure
 
-	// Error check
-	if(retval != 0 && netSuccess != 0){
-		logMessage(FS3DriverLLevel, "Systemcall to unmount file system failed, exiting program ");
-		return(-1); // Failed
+int16_t findFreeRun(int16_t want, int16_t *trkidx, int16_t *secidx){
+
+	// Local variables
+	int16_t bestTrk = -1, bestSec = -1, bestLen = 0; // Longest run seen so far
+
+	// Loop through all possible tracks
+	for(int trk=0; trk<FS3_MAX_TRACKS; trk++){
+
+		int16_t sec;
+		int16_t len = findRunOnTrack(trk, want, &sec);
+
+		// Take the first run that is long enough
+		if(len >= want){
+			*trkidx = trk;
+			*secidx = sec;
+			markSectors(trk, sec, want); // Update global bitmap
+			return(want);
+		}
+
+		// Remember the longest run in case none is long enough
+		if(len > bestLen){
+			bestTrk = trk;
+			bestSec = sec;
+			bestLen = len;
+		}
 	}
 
-	 // Successful unmount
-	logMessage(FS3DriverLLevel, "FS3 DRVR: unmounted.");
-	strcpy(mountState, "unmounted");
-	return(0);
+	// Settle for the longest run
+	if(bestLen > 0){
+		*trkidx = bestTrk;
+		*secidx = bestSec;
+		markSectors(bestTrk, bestSec, bestLen); // Update global bitmap
+		return(bestLen);
+	}
+	
+	// Log info
+	logMessage(FS3DriverLLevel, "Could not find a free trk/sec, exiting the program");
+	return(-1);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : fs3_open
-// Description  : This function opens the file and returns a file handle
+// Function     : frontierTrack
+// Description  : finds the first track with a free run of at least "want" sectors,
+//                the track first fit would use. Sectors other files set aside on a
+//                track are taken back before passing over it, so reservations never
+//                push data onto more tracks. Otherwise the longest run is returned.
 //
-// Inputs       : path - filename of the file to open
-// Outputs      : file handle if successful, -1 if failure
+// Inputs       : want - number of sectors wanted
+//              : *secidx - Pointer to the storage variable (first sector of the run)
+//
+// Outputs      : track index if success, -1 if every track is full
 
-int16_t fs3_open(char *path) { // Path is a pointer "assign2/penn-state.txt"
+int16_t frontierTrack(int16_t want, int16_t *secidx){
 
 	// Local variables
-	int16_t idx =  0; // if idx==1023, all files have been checked
-
-	// Loop through all possible files 
-	for(int i=0; i<MAX_FILES; i++){ // i is the ftable we are currently working with
-
-		// Find the file that correponds with the name 'path'
-		if(strcmp(ftable[i].fname, path) == 0){
-
-			// File with the 'path' == 'fname' found
-			if(strncmp(ftable[i].fstate, "opened", 6) == 0){ // If the corresponding file state is already "opened"
-				logMessage(FS3DriverLLevel, "File [%s] already opened, exiting program", path); // Log creation of new file
-				return(-1); 
-			}else{ // File is closed, initalize values of oftable to those in ftable
-				logMessage(FS3DriverLLevel, "Driver opening existing file [%s]", path); // Log creation of new file
-
-				// Pick a unique file handle 
-				oftable[freeOFile].ofhandle = freeHandle; // Set file handle to a unique number
-
-				// Update the open file to all the previous declarations in ftable
-				strcpy(oftable[freeOFile].ofname, path); // Set open file name 
-				strcpy(ftable[i].fstate, "opened");// Set open file state to opened 
-				oftable[freeOFile].oflength = ftable[i].flength; // Set open file length  
-				oftable[freeOFile].numsec = ftable[i].numsec; // Set number of sectors
-				
-				// Copy all track/sector combinations over to the open file
-				memcpy(&oftable[freeOFile].ofloc[0][0], &ftable[i].floc[0][0], sizeof(oftable[freeOFile].ofloc[0][0])*FS3_MAX_TRACKS*FS3_TRACK_SIZE);
-
-				break; // Break out of for loop because file inialized
+	int16_t bestTrk = -1, bestSec = -1, bestLen = 0; // Longest run seen so far
+
+	// Loop through all possible tracks
+	for(int16_t trk = 0; trk < FS3_MAX_TRACKS; trk++){
+
+		int16_t sec;
+		int16_t len = findRunOnTrack(trk, want, &sec);
+
+		// Take back the reservations on the track before passing over it
+		if(len < want){
+			int8_t released = 0;
+			for(int16_t f = 0; f < freeFile; f++){
+				if(ftable[f].fresv.elen > 0 && ftable[f].fresv.etrk == trk){
+					releaseReservation(f);
+					released = 1;
+				}
 			}
-		}else{ // If the file at index 'i' does not have fname == path,
+			if(released){
+				len = findRunOnTrack(trk, want, &sec);
+			}
+		}
 
-			idx++; // Increment idx by one
+		// Take the first run that is long enough
+		if(len >= want){
+			*secidx = sec;
+			return(trk);
 		}
 
-		// Check to see if all the files have been looped through and the file is not found
-		if(idx == MAX_FILES){ // If none of the files have fname == path, make a new file
-			logMessage(FS3DriverLLevel, "Driver creating new file [%s]", path); // Log creation of new file
-			strcpy(ftable[freeFile].fname, path); // Copy the path name to the permanent file name
-			
-			// Initialize
-			oftable[freeOFile].numsec = 0;
+		// Remember the longest run in case none is long enough
+		if(len > bestLen){
+			bestTrk = trk;
+			bestSec = sec;
+			bestLen = len;
+		}
+	}
+
+	*secidx = bestSec;
+	return(bestTrk);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : findAffinityRun
+// Description  : allocates up to "want" sectors for a file out of its reservation.
+//                An empty reservation is refilled on the track first fit would use,
+//                right after the file's last sector when that is on the same track
+//                and still free. A refill sets aside at most the window, and never
+//                more than the file already holds, so small files waste no space.
+//
+// Inputs       : fidx - index of the permanent file being extended
+//              : have - number of sectors the file already has
+//              : want - number of sectors wanted
+//              : *trkidx - Pointer to the storage variable (track of the run)
+//				: *secidx - Pointer to the storage variable (first sector of the run)
+//
+// Outputs      : number of sectors allocated if success, -1 if failure
+
+int16_t findAffinityRun(int16_t fidx, int32_t have, int16_t want, int16_t *trkidx, int16_t *secidx){
 
-			// Pick a unique file handle 
-			oftable[freeOFile].ofhandle = freeHandle;   // Set file handle to a unique number
+	// Local variables
+	FS3Extent *resv = &ftable[fidx].fresv; // Sectors set aside for the file
 
-			// Update the open file to all the previous declarations in ftable
-			strcpy(oftable[freeOFile].ofname, path);      // Set open file name 
-			strcpy(ftable[freeOFile].fstate, "opened");   // Set permanant file state to opened 
-			oftable[freeOFile].oflength = 0;              // Set open file length 
-			oftable[freeOFile].ofpos    = 0; 		      // Set position to the first byte
+	// Refill the reservation when it runs dry
+	if(resv->elen == 0){
 
-			freeFile++; // Increment freeFile by one to keep it unique
-			break; // Breaks out of the for loop
+		// Reserve what was asked for, more as the file grows, at most a track
+		int32_t window = (have < fs3AllocWindow) ? have : fs3AllocWindow;
+		int16_t trk, sec, len;
+		if(window < want){
+			window = want;
+		}
+		if(window > FS3_TRACK_SIZE){
+			window = FS3_TRACK_SIZE;
 		}
-	}
 
-	// Log the info
-	logMessage(FS3DriverLLevel, "File [%s] opened in driver, fh = %d.", oftable[freeOFile].ofname, oftable[freeOFile].ofhandle);
+		// Check for failure
+		trk = frontierTrack(want, &sec);
+		if(trk == -1){
+			logMessage(FS3DriverLLevel, "Could not find a free trk/sec, exiting the program");
+			return(-1);
+		}
 
-	// Increment all used variables to keep them unique
-	freeOFile++; // Move free file pointer to the next index
-	freeHandle++; // Move free handle pointer to the next index
+		// Keep growing right where the file left off if it is on this track
+		if(ftable[fidx].ftrk == trk && resv->esec < FS3_TRACK_SIZE && nextFreeSec(trk, resv->esec) == resv->esec){
+			sec = resv->esec;
+		}
 
-	// Return the file handle of the file to open (-1 to correct for the above incrementation)
-	return(oftable[freeOFile - 1].ofhandle);
+		// Set the window aside for the file
+		len = nextUsedSec(trk, sec) - sec;
+		if(len > window){
+			len = window;
+		}
+		markSectors(trk, sec, len); // Update global bitmap
+		ftable[fidx].ftrk = trk;
+		resv->etrk = trk;
+		resv->esec = sec;
+		resv->elen = len;
+	}
+
+	// Hand out sectors from the front of the reservation
+	int16_t got = (want < resv->elen) ? want : resv->elen;
+	*trkidx = resv->etrk;
+	*secidx = resv->esec;
+	resv->esec += got;
+	resv->elen -= got;
+	return(got);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : fs3_close
-// Description  : This function closes the file
+// Function     : allocSectors
+// Description  : allocates a run of up to "want" contiguous sectors for a file
+//                using the configured allocation policy
 //
-// Inputs       : fd - the file descriptor
-// Outputs      : 0 if successful, -1 if failure
+// Inputs       : fidx - index of the permanent file being extended
+//              : want - number of sectors wanted
+//              : *trkidx - Pointer to the storage variable (track of the run)
+//				: *secidx - Pointer to the storage variable (first sector of the run)
+//
+// Outputs      : number of sectors allocated if success, -1 if failure
 
-int16_t fs3_close(int16_t fd) {
+int16_t allocSectors(int16_t fidx, int32_t have, int16_t want, int16_t *trkidx, int16_t *secidx){
 
-	// Local variables
-	int16_t fidx   = -1; // Index of the permanant file corresponding to the file handle
-	int16_t ofidx  = -1; // Index of the open file corresponding to the file handle
-	int16_t idxRet = -1; // Initial value
+	if(fs3AllocPolicy == FS3_ALLOC_AFFINITY){
+		return(findAffinityRun(fidx, have, want, trkidx, secidx));
+	}
 
-	idxRet = idxByHandle(fd, &ofidx, &fidx); // Get file indexes
+	return(findFreeRun(want, trkidx, secidx));
+}
 
-	if(idxRet == -1){ // Check for success
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_set_alloc_policy
+// Description  : selects how new sectors are placed on the disk
+//
+// Inputs       : policy - FS3_ALLOC_FIRSTFIT or FS3_ALLOC_AFFINITY
+//              : window - sectors reserved for a file at a time (affinity only)
+//
+// Outputs      : 0 if success, -1 if failure
+
+int fs3_set_alloc_policy(FS3AllocPolicy policy, uint16_t window){
+
+	// Failure condition
+	if(policy != FS3_ALLOC_FIRSTFIT && policy != FS3_ALLOC_AFFINITY){
+		logMessage(FS3DriverLLevel, "Unknown allocation policy %d, exiting program", policy);
+		return(-1);
+	}
+	if(window < 1 || window > FS3_TRACK_SIZE){
+		logMessage(LOG_ERROR_LEVEL, "Allocation window must be 1 to %d sectors, exiting program", FS3_TRACK_SIZE);
 		return(-1);
 	}
 
-	////////////////////////////////////////////////////////////////
-	// 						FAILURE CONTITIONS                    //
-	////////////////////////////////////////////////////////////////
+	fs3AllocPolicy = policy;
+	fs3AllocWindow = window;
+	logMessage(FS3DriverLLevel, "Allocation policy set to [%s], window %d sectors",
+		(policy == FS3_ALLOC_AFFINITY) ? "affinity" : "firstfit", window);
+	return(0);
+}
 
-	if(ofidx == -1 || fidx == -1){
-		// File handle not found
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_set_readahead
+// Description  : sets the largest window sequential readers prefetch
+//
+// Inputs       : maxWindow - largest readahead window in sectors, 0 turns it off
+//
+// Outputs      : 0 if success, -1 if failure
+
+int fs3_set_readahead(uint16_t maxWindow){
+
+	fs3ReadAheadMax = maxWindow;
+	logMessage(FS3DriverLLevel, "Readahead window set to at most %d sectors", maxWindow);
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_set_fill_group
+// Description  : sets the aligned group of sectors a read miss fills in one go,
+//                1 for the missed sector alone up to a whole track
+//
+// Inputs       : sectors - group size, a power of two up to FS3_TRACK_SIZE
+//
+// Outputs      : 0 if success, -1 if failure
+
+int fs3_set_fill_group(uint16_t sectors){
+
+	// Groups are aligned, so they must divide the track
+	if(sectors == 0 || sectors > FS3_TRACK_SIZE || (sectors & (sectors - 1)) != 0){
+		logMessage(LOG_ERROR_LEVEL, "Fill group must be a power of two up to %d sectors [%d]", FS3_TRACK_SIZE, sectors);
+		return(-1);
+	}
+
+	fs3FillGroup = sectors;
+	logMessage(FS3DriverLLevel, "Read misses fill groups of %d sectors", sectors);
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_log_driver_metrics
+// Description  : Log the controller operations the driver issued
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int fs3_log_driver_metrics(void){
+
+	// Log block
+	logMessage(LOG_OUTPUT_LEVEL, "** FS3 Driver Metrics **");
+	logMessage(LOG_OUTPUT_LEVEL, "Allocation      [%s, window %d, %d runs]", (fs3AllocPolicy == FS3_ALLOC_AFFINITY) ? "affinity" : "firstfit", fs3AllocWindow, driverExtents);
+	logMessage(LOG_OUTPUT_LEVEL, "Readahead       [up to %d sectors]", fs3ReadAheadMax);
+	if(fs3FillGroup > 1){
+		logMessage(LOG_OUTPUT_LEVEL, "Group Fills     [%d sector groups, %d fills, %d sectors]", fs3FillGroup, driverFills, driverFillSectors);
+	}
+	logMessage(LOG_OUTPUT_LEVEL, "Track Seeks     [%d]", driverSeeks);
+	logMessage(LOG_OUTPUT_LEVEL, "Scheduler       [C-LOOK, %d batches, %d seeks saved, avg seek distance %.2f tracks]", schedBatches, schedSeeksSaved,
+		(driverSeeks > 0) ? (double)driverSeekDistance / driverSeeks : 0.0);
+	logMessage(LOG_OUTPUT_LEVEL, "Pipeline        [window %d, %d batches, %.2f sector operations per batch]", network_fs3_window(), driverBatches,
+		(driverBatches > 0) ? (double)driverBatchOps / driverBatches : 0.0);
+	logMessage(LOG_OUTPUT_LEVEL, "Sector Reads    [%d]", driverReads);
+	logMessage(LOG_OUTPUT_LEVEL, "Sector Writes   [%d]", driverWrites);
+
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : appendExtent
+// Description  : adds a sector to the end of an extent list, merging it into the
+//                last extent when it is physically contiguous with it
+//
+// Inputs       : **ext - Pointer to the extent list (may be reallocated)
+//              : *numext - Pointer to the number of extents in the list
+//              : *extcap - Pointer to the number of extents the list has room for
+//              : trk - track of the sector to add
+//              : sec - sector to add
+//
+// Outputs      : 0 if success, -1 if failure
+
+int8_t appendExtent(FS3Extent **ext, int32_t *numext, int32_t *extcap, int16_t trk, int16_t sec){
+
+	// Local variables
+	FS3Extent *last = (*numext > 0) ? &(*ext)[*numext - 1] : NULL;
+
+	// Grow the last run if the sector directly follows it on the same track
+	if(last != NULL && last->etrk == trk && last->esec + last->elen == sec){
+		last->elen++;
+		return(0);
+	}
+
+	// Make room for a new run if the list is full
+	if(*numext == *extcap){
+		int32_t newCap = (*extcap == 0) ? EXTENT_INIT_CAP : *extcap*2;
+		FS3Extent *newExt = realloc(*ext, sizeof(FS3Extent)*newCap);
+
+		// Check for success
+		if(newExt == NULL){
+			logMessage(FS3DriverLLevel, "Memory allocation for %d extents failed, exiting program", newCap);
+			return(-1);
+		}
+
+		*ext = newExt;
+		*extcap = newCap;
+	}
+
+	// Start a new run at the end of the list
+	(*ext)[*numext].etrk = trk;
+	(*ext)[*numext].esec = sec;
+	(*ext)[*numext].elen = 1;
+	(*numext)++;
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : buildSectorMap
+// Description  : expands the extent list of an open file into its sector map, so
+//                file sector 'n' is found at ofmap[n]
+//
+// Inputs       : ofidx - index of the open file
+//
+// Outputs      : 0 if success, -1 if failure
+
+int8_t buildSectorMap(int16_t ofidx){
+
+	// Local variables
+	int32_t mapcap = (oftable[ofidx].numsec > SECMAP_INIT_CAP) ? oftable[ofidx].numsec : SECMAP_INIT_CAP;
+	int32_t fsec   = 0; // Next file sector to fill in
+
+	// Allocate room for every sector the file owns
+	oftable[ofidx].ofmap = malloc(sizeof(FS3SectorLoc)*mapcap);
+
+	// Check for success
+	if(oftable[ofidx].ofmap == NULL){
+		logMessage(FS3DriverLLevel, "Memory allocation for a %d sector map failed, exiting program", mapcap);
+		oftable[ofidx].ofmapcap = 0;
+		return(-1);
+	}
+	oftable[ofidx].ofmapcap = mapcap;
+
+	// Unroll every run into one entry per sector
+	for(int e = 0; e<oftable[ofidx].ofnumext; e++){
+		for(int k = 0; k<oftable[ofidx].ofext[e].elen; k++){
+			oftable[ofidx].ofmap[fsec].strk = oftable[ofidx].ofext[e].etrk;
+			oftable[ofidx].ofmap[fsec].ssec = oftable[ofidx].ofext[e].esec + k;
+			fsec++;
+		}
+	}
+
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : addFileSector
+// Description  : adds a newly allocated sector to the end of an open file, in both
+//                its extent list and its sector map
+//
+// Inputs       : ofidx - index of the open file
+//              : trk - track of the new sector
+//              : sec - sector of the new sector
+//
+// Outputs      : 0 if success, -1 if failure
+
+int8_t addFileSector(int16_t ofidx, int16_t trk, int16_t sec){
+
+	// Make room in the sector map if it is full
+	if(oftable[ofidx].numsec == oftable[ofidx].ofmapcap){
+		int32_t newCap = (oftable[ofidx].ofmapcap == 0) ? SECMAP_INIT_CAP : oftable[ofidx].ofmapcap*2;
+		FS3SectorLoc *newMap = realloc(oftable[ofidx].ofmap, sizeof(FS3SectorLoc)*newCap);
+
+		// Check for success
+		if(newMap == NULL){
+			logMessage(FS3DriverLLevel, "Memory allocation for a %d sector map failed, exiting program", newCap);
+			return(-1);
+		}
+
+		oftable[ofidx].ofmap    = newMap;
+		oftable[ofidx].ofmapcap = newCap;
+	}
+
+	// Record the run the sector belongs to
+	int32_t runs = oftable[ofidx].ofnumext;
+	if(appendExtent(&oftable[ofidx].ofext, &oftable[ofidx].ofnumext, &oftable[ofidx].ofextcap, trk, sec) == -1){
+		return(-1);
+	}
+	driverExtents += oftable[ofidx].ofnumext - runs;
+
+	// Record the sector at the end of the map
+	oftable[ofidx].ofmap[oftable[ofidx].numsec].strk = trk;
+	oftable[ofidx].ofmap[oftable[ofidx].numsec].ssec = sec;
+	oftable[ofidx].numsec++;
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : idxByHandle
+// Description  : returns the file index associated with a file handle
+//
+// Inputs       : fd - file handle to find index of 
+//              : *ofidx - Pointer to the storage variable
+//				: *fidx  - Pointer to the storage variable
+//
+// Outputs      : 0 if success, -1 if failure
+
+int16_t idxByHandle(int16_t fd, int16_t *ofidx, int16_t *fidx){
+
+	// Handles index the handle table directly
+	if(fd > 0 && fd <= MAX_FILES && htable[fd].hofidx != -1){
+
+		*ofidx = htable[fd].hofidx; // Set pointer to ofidx to the open file index
+		*fidx  = htable[fd].hfidx;  // Set pointer to fidx to the permanant file index
+		return(0);
+	}
+
+	// Log info
+	logMessage(FS3DriverLLevel, "File/OFile index not found, exiting program");
+	return(-1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : openedByHandle
+// Description  : resolves a file handle once for an I/O call and makes sure the
+//                file it refers to is open
+//
+// Inputs       : fd - file handle to find index of 
+//              : *ofidx - Pointer to the storage variable
+//				: *fidx  - Pointer to the storage variable
+//
+// Outputs      : 0 if success, -1 if failure
+
+int16_t openedByHandle(int16_t fd, int16_t *ofidx, int16_t *fidx){
+
+	// Get file indexes
+	if(idxByHandle(fd, ofidx, fidx) == -1 || *ofidx == -1 || *fidx == -1){ 
+		logMessage(FS3DriverLLevel, "Failed to find file index, exiting program");
+		return(-1);  
+	}
+
+	// End the program if the file is not open
+	if(strcmp(ftable[*fidx].fstate, "opened") != 0){ 
+		logMessage(FS3DriverLLevel, "File not opened, exiting program");
+		return(-1);  
+	}
+
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : hashFileName
+// Description  : hashes a filename into a bucket of the filename index (FNV-1a)
+//
+// Inputs       : path - filename to hash
+//
+// Outputs      : bucket index of the filename
+
+uint32_t hashFileName(const char *path){
+
+	// Local variables
+	uint32_t hash = 2166136261u; // FNV offset basis
+
+	// Fold in every character of the name
+	for(const unsigned char *c = (const unsigned char *)path; *c != '\0'; c++){
+		hash ^= *c;
+		hash *= 16777619u; // FNV prime
+	}
+
+	return(hash & (FILE_HASH_SIZE - 1));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : findFileByName
+// Description  : returns the permanent file index of the file named "path"
+//
+// Inputs       : path - filename to look up
+//
+// Outputs      : file index if found, -1 if not found
+
+int16_t findFileByName(const char *path){
+
+	// Probe from the name's bucket until an empty bucket ends the chain
+	for(uint32_t b = hashFileName(path), n = 0; n < FILE_HASH_SIZE; b = (b + 1) & (FILE_HASH_SIZE - 1), n++){
+
+		if(fileHash[b] == -1){ // Name was never added
+			return(-1);
+		}else if(strcmp(ftable[fileHash[b]].fname, path) == 0){ // Names match
+			return(fileHash[b]);
+		}
+	}
+
+	return(-1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : addFileName
+// Description  : adds a permanent file to the filename index under its fname
+//
+// Inputs       : fidx - index of the permanent file
+//
+// Outputs      : 0 if success, -1 if failure
+
+int8_t addFileName(int16_t fidx){
+
+	// Probe from the name's bucket for the first empty bucket
+	for(uint32_t b = hashFileName(ftable[fidx].fname), n = 0; n < FILE_HASH_SIZE; b = (b + 1) & (FILE_HASH_SIZE - 1), n++){
+
+		if(fileHash[b] == -1){
+			fileHash[b] = fidx;
+			return(0);
+		}
+	}
+
+	// Log info
+	logMessage(FS3DriverLLevel, "Filename index is full, cannot add [%s], exiting program", ftable[fidx].fname);
+	return(-1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : construct_fs3_cmdblock
+// Description  : Constructs the command block to communicate with the controller
+//
+// Inputs       : op - operation code to run
+//              : sec - sector number to operate on
+//              : trk - track number to operate on 
+// Outputs      : retval - the constructed commandblock
+
+FS3CmdBlk construct_fs3_cmdblock(uint8_t op, uint16_t sec, uint_fast32_t trk, uint8_t ret){
+	
+	// Local Variables for the function
+	FS3CmdBlk tmpop = 0, tmpsec = 0, tmptrk = 0, tmpret = 0, retval = 0; 
+	
+	// Opcode cast and shift
+	tmpop = (FS3CmdBlk)op << 60; // Shifts it to bits 0-3
+	
+	// Sector cast and shift
+	tmpsec = (FS3CmdBlk)sec << 44; // Shifts it to bits 4-19
+	
+	// Track cast and shift
+	tmptrk = (FS3CmdBlk)trk << 12; // Shifts it to bits 20-51
+	
+	// Return cast and shift
+	tmpret = (FS3CmdBlk)ret << 11; // Shifts it to bit 52
+	
+	// Bitwise or all shifter bits together
+	retval = (FS3CmdBlk)(tmpop | tmpsec | tmptrk | tmpret); 
+	
+	return(retval);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : deconstruct_fs3_cmdblock
+// Description  : Deonstructs the command block to get the changed values from fs3_syscall
+//
+// Inputs       : *op - pointer to the operation code
+//              : *sec - pointer to the sector number to operate on
+//              : *trk - pointer to the track number to operate on 
+// Outputs      : Void
+
+void deconstruct_fs3_cmdblock(FS3CmdBlk cmdblk, uint8_t *op, uint16_t *sec, uint_fast32_t *trk, uint8_t *ret){
+	
+	// Mask the command block to isolate the opcode 
+	*op = (cmdblk&0xf000000000000000) >> 60; // Set 'op'(&opval) to the least signifigant 4 bits
+
+	// Mask the commandblock to isolate the sector
+	*sec = (cmdblk&0x0fff000000000000) >> 44; // Set 'sec'(&secval) to the least signifigant 16 bits
+
+	// Mask the commandblock to isolate the track
+	*trk = (cmdblk&0x00001fffffffe000) >> 12; // Set 'trk'(&trkval) to the  least signifigant 32 bits
+
+	// Mask the commandblock to isolate the return value
+	*ret = (cmdblk&0x0000000000000800) >> 11; // Set 'ret'(&retval) to the least signifigant  8 bits
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_mount_disk
+// Description  : FS3 interface, mount/initialize filesystem
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int32_t fs3_mount_disk(void) {
+
+	// Check to see if file system is already mounted
+	if(strncmp(mountState, "mounted", 7) == 0){
+		logMessage(FS3DriverLLevel, "FS3 DRVR: File system already mounted, exiting program");
+		return(-1); // FS already mounted, end the program
+	}
+
+	// Make commandblock telling the controller to mount to the disk
+	FS3CmdBlk retCmd;
+	
+	int netSuccess = network_fs3_syscall(construct_fs3_cmdblock(FS3_OP_MOUNT,0,0,0), &retCmd, NULL);
+
+	// Deconstructing the fs3_syscall cmdblk to see if it worked
+	deconstruct_fs3_cmdblock(retCmd, &opval, &secval, &trkval, &retval);
+
+	if(retval == 0 && netSuccess == 0){ // Test the output of retval
+		logMessage(FS3DriverLLevel, "FS3 DRVR: mounted.\n");    // Log success
+		memset(ftable,    0x0, sizeof(FS3File)*MAX_FILES);      // Initalize ftable to 0
+		memset(oftable,   0x0, sizeof(FS3OpenFile)*MAX_FILES);  // Initalize oftable to 0
+		memset(freeMap,   0x0, sizeof(freeMap));                // Initalize every sector to free
+		memset(fileHash,  0xff, sizeof(fileHash));              // Initalize every bucket to empty (-1)
+		memset(htable,    0xff, sizeof(htable));                // Initalize every handle to unused (-1)
+		strcpy(mountState, "mounted");
+		return(0); // Passed
+	}else{
+		logMessage(FS3DriverLLevel, "FS3 DRVR: Systemcall to mount file system failed, exiting program");
+		return(-1); // Failed
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_unmount_disk
+// Description  : FS3 interface, unmount the disk, close all files
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int32_t fs3_unmount_disk(void) {
+
+	// Check to make sure FS was already mounted
+	if(strncmp(mountState, "mounted", 7) != 0){
+		logMessage(FS3DriverLLevel, "FS3 DRVR: Filesystem not mounted, unable to unmount an unmounted system. Exiting the program");
+		return(-1); // FS is not mounted, bail out
+	}
+
+	// Cleaning up internal data structure
+	for(int fd = 1; fd < freeHandle; fd++){
+		if(htable[fd].hofidx != -1){
+			fs3_close(fd); // Close the respective file handle
+		}
+	}
+
+	// Anything still dirty in the cache has to reach the disk before it goes away
+	if(fs3_flush_cache(NULL, 0) == -1){
+		logMessage(FS3DriverLLevel, "Failed to flush the cache before unmounting, exiting program");
+		return(-1);
+	}
+	
+	// Local variable
+	FS3CmdBlk retCmd;
+
+	// Make commandblock telling the controller to unmount from the disk
+	int netSuccess = network_fs3_syscall(construct_fs3_cmdblock(FS3_OP_UMOUNT,0,0,0), &retCmd, NULL);
+
+	// Deconsteruction
+	deconstruct_fs3_cmdblock(retCmd, &opval, &secval, &trkval, &retval);
+
+	// Error check
+	if(retval != 0 && netSuccess != 0){
+		logMessage(FS3DriverLLevel, "Systemcall to unmount file system failed, exiting program ");
+		return(-1); // Failed
+	}
+
+	// Release the extent lists of every file
+	for(int i = 0; i < MAX_FILES; i++){
+		free(ftable[i].fext);
+		free(oftable[i].ofext);
+		free(oftable[i].ofmap);
+		ftable[i].fext = NULL;
+		oftable[i].ofext = NULL;
+		oftable[i].ofmap = NULL;
+	}
+
+	 // Successful unmount
+	logMessage(FS3DriverLLevel, "FS3 DRVR: unmounted.");
+	strcpy(mountState, "unmounted");
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_open
+// Description  : This function opens the file and returns a file handle
+//
+// Inputs       : path - filename of the file to open
+// Outputs      : file handle if successful, -1 if failure
+
+int16_t fs3_open(char *path) { // Path is a pointer "assign2/penn-state.txt"
+
+	// Local variables
+	int16_t fidx = -1; // Index of the permanent file with the name 'path'
+
+	// Open file slots are never reused, bail out once they run out
+	if(freeOFile >= MAX_FILES){
+		logMessage(FS3DriverLLevel, "Open file table is full, cannot open [%s], exiting program", path);
+		return(-1);
+	}
+
+	// Find the file that correponds with the name 'path'
+	fidx = findFileByName(path);
+
+	if(fidx != -1){ // File with the 'path' == 'fname' found
+
+		if(strncmp(ftable[fidx].fstate, "opened", 6) == 0){ // If the corresponding file state is already "opened"
+			logMessage(FS3DriverLLevel, "File [%s] already opened, exiting program", path); // Log creation of new file
+			return(-1); 
+		}
+
+		// File is closed, initalize values of oftable to those in ftable
+		logMessage(FS3DriverLLevel, "Driver opening existing file [%s]", path); // Log creation of new file
+
+		// Pick a unique file handle 
+		oftable[freeOFile].ofhandle = freeHandle; // Set file handle to a unique number
+
+		// Update the open file to all the previous declarations in ftable
+		strcpy(oftable[freeOFile].ofname, path); // Set open file name 
+		strcpy(ftable[fidx].fstate, "opened");// Set open file state to opened 
+		oftable[freeOFile].oflength = ftable[fidx].flength; // Set open file length  
+		oftable[freeOFile].numsec = ftable[fidx].numsec; // Set number of sectors
+		
+		// Copy all track/sector runs over to the open file
+		oftable[freeOFile].ofnumext = 0;
+		oftable[freeOFile].ofextcap = 0;
+		oftable[freeOFile].ofext    = NULL;
+		if(ftable[fidx].fnumext > 0){
+			oftable[freeOFile].ofext = malloc(sizeof(FS3Extent)*ftable[fidx].fnumext);
+
+			// Check for success
+			if(oftable[freeOFile].ofext == NULL){
+				logMessage(FS3DriverLLevel, "Memory allocation for the extents of [%s] failed, exiting program", path);
+				strcpy(ftable[fidx].fstate, "closed");
+				return(-1);
+			}
+
+			memcpy(oftable[freeOFile].ofext, ftable[fidx].fext, sizeof(FS3Extent)*ftable[fidx].fnumext);
+			oftable[freeOFile].ofnumext = ftable[fidx].fnumext;
+			oftable[freeOFile].ofextcap = ftable[fidx].fnumext;
+		}
+
+		// Index every sector of the file by its position in the file
+		if(buildSectorMap(freeOFile) == -1){
+			strcpy(ftable[fidx].fstate, "closed");
+			return(-1);
+		}
+	}else{ // If none of the files have fname == path, make a new file
+
+		// Check for room in the permanent file table
+		if(freeFile >= MAX_FILES){
+			logMessage(FS3DriverLLevel, "File table is full, cannot create [%s], exiting program", path);
+			return(-1);
+		}
+
+		logMessage(FS3DriverLLevel, "Driver creating new file [%s]", path); // Log creation of new file
+		fidx = freeFile;
+		strcpy(ftable[fidx].fname, path); // Copy the path name to the permanent file name
+		ftable[fidx].ftrk = -1;           // Not grown yet
+
+		// Make the new file findable by name
+		if(addFileName(fidx) == -1){
+			return(-1);
+		}
+		
+		// Initialize
+		oftable[freeOFile].numsec   = 0;
+		oftable[freeOFile].ofext    = NULL; // No sectors yet
+		oftable[freeOFile].ofnumext = 0;
+		oftable[freeOFile].ofextcap = 0;
+		oftable[freeOFile].ofmap    = NULL;
+		oftable[freeOFile].ofmapcap = 0;
+
+		// Pick a unique file handle 
+		oftable[freeOFile].ofhandle = freeHandle;   // Set file handle to a unique number
+
+		// Update the open file to all the previous declarations in ftable
+		strcpy(oftable[freeOFile].ofname, path);      // Set open file name 
+		strcpy(ftable[fidx].fstate, "opened");        // Set permanant file state to opened 
+		oftable[freeOFile].oflength = 0;              // Set open file length 
+		oftable[freeOFile].ofpos    = 0; 		      // Set position to the first byte
+
+		freeFile++; // Increment freeFile by one to keep it unique
+	}
+
+	// Nothing read yet, a first read from the start counts as sequential
+	oftable[freeOFile].ofranext = 0;
+	oftable[freeOFile].ofrasize = 0;
+	oftable[freeOFile].ofraend  = 0;
+
+	// Let the handle resolve straight to both table entries
+	htable[freeHandle].hofidx = freeOFile;
+	htable[freeHandle].hfidx  = fidx;
+
+	// Log the info
+	logMessage(FS3DriverLLevel, "File [%s] opened in driver, fh = %d.", oftable[freeOFile].ofname, oftable[freeOFile].ofhandle);
+
+	// Increment all used variables to keep them unique
+	freeOFile++; // Move free file pointer to the next index
+	freeHandle++; // Move free handle pointer to the next index
+
+	// Return the file handle of the file to open (-1 to correct for the above incrementation)
+	return(oftable[freeOFile - 1].ofhandle);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_close
+// Description  : This function closes the file
+//
+// Inputs       : fd - the file descriptor
+// Outputs      : 0 if successful, -1 if failure
+
+int16_t fs3_close(int16_t fd) {
+
+	// Local variables
+	int16_t fidx   = -1; // Index of the permanant file corresponding to the file handle
+	int16_t ofidx  = -1; // Index of the open file corresponding to the file handle
+	int16_t idxRet = -1; // Initial value
+
+	idxRet = idxByHandle(fd, &ofidx, &fidx); // Get file indexes
+
+	if(idxRet == -1){ // Check for success
+		return(-1);
+	}
+
+	////////////////////////////////////////////////////////////////
+	// 						FAILURE CONTITIONS                    //
+	////////////////////////////////////////////////////////////////
+
+	if(ofidx == -1 || fidx == -1){
+		// File handle not found
+		return(0);
+	}else if(strncmp(ftable[fidx].fstate, "closed", 6) == 0){ // If the file is not open
+		// File is already closed / was never opened
+		logMessage(FS3DriverLLevel, "File refrenced by fh %d not open.", fd);
+		return(-1);
+	}else{
+
+		////////////////////////////////////////////////////////////////
+		// 						SAVING NEW DATA                       //
+		////////////////////////////////////////////////////////////////
+
+		// Write the file's dirty sectors out of the cache
+		if(fs3_flush_cache(oftable[ofidx].ofext, oftable[ofidx].ofnumext) == -1){
+			logMessage(FS3DriverLLevel, "Failed to flush fh %d on close, exiting program", fd);
+			return(-1);
+		}
+
+		ftable[fidx].flength = oftable[ofidx].oflength;  // Record new metadata into permanent table
+		ftable[fidx].numsec = oftable[ofidx].numsec;     // Record new metadata
+		strcpy(ftable[fidx].fstate, "closed"); 	 		 // Set the file to closed
+		releaseReservation(fidx);                        // Closed files do not grow, free the sectors set aside
+
+		// Save all track/sector runs (the permanent file takes over the open file's list)
+		free(ftable[fidx].fext);
+		ftable[fidx].fext    = oftable[ofidx].ofext;
+		ftable[fidx].fnumext = oftable[ofidx].ofnumext;
+		ftable[fidx].fextcap = oftable[ofidx].ofextcap;
+
+		////////////////////////////////////////////////////////////////
+		// 				RESET ALL OPEN FILE PARAMETERS                //
+		////////////////////////////////////////////////////////////////
+
+		oftable[ofidx].oflength =  0; // Set back to original value
+		oftable[ofidx].ofhandle = -1; // Set back to original value
+		htable[fd].hofidx       = -1; // Handle no longer resolves
+		htable[fd].hfidx        = -1; // Handle no longer resolves
+		oftable[ofidx].ofpos    =  0; // Set back to original value
+		oftable[ofidx].numsec   =  0; // Set back to original value
+	
+		// The track/sector runs now belong to the permanent file
+		oftable[ofidx].ofext    = NULL;
+		oftable[ofidx].ofnumext = 0;
+		oftable[ofidx].ofextcap = 0;
+
+		// The sector map is rebuilt the next time the file is opened
+		free(oftable[ofidx].ofmap);
+		oftable[ofidx].ofmap    = NULL;
+		oftable[ofidx].ofmapcap = 0;
+
+		// Log info
+		logMessage(FS3DriverLLevel, "File contents of fh %d, [%s] saved.", fd, ftable[fidx].fname);
+		return (0); // Return 0 to indicate success
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fetchSector
+// Description  : finds the contents of one sector without copying them, from the
+//                cache when it is there and from the controller (into "scratch",
+//                filling the cache) when it is not
+//
+// Inputs       : trk - track of the sector
+//                sec - sector to read
+//                scratch - sector sized buffer to receive into on a cache miss
+//                ready - 1 if a pipelined read already received the sector into
+//                        "scratch", 0 if a miss has to read it
+// Outputs      : pointer to the sector contents if successful, NULL if failure
+
+char * fetchSector(int16_t trk, int16_t sec, char *scratch, int8_t ready){
+
+	// Local variables
+	char *cachePtr;
+
+	// Check to see if it was found in the cache (no seek needed then)
+	cachePtr = fs3_get_cache(trk, sec);
+	if(cachePtr != NULL){
+		return(cachePtr);
+	}
+
+	logMessage(FS3DriverLLevel, "[trk = %d, sec = %d] not found in cache", trk, sec);
+
+	// Read the sector from the controller (seeks to its track first)
+	if(!ready && readSectorDisk(trk, sec, scratch) == -1){
+		return(NULL);
+	}
+
+	// Place data in the cache
+	if(fs3_put_cache(trk, sec, scratch) == -1){
+		logMessage(FS3DriverLLevel, "Failed to palce data in cache, exiting program");
+		return(NULL);
+	}
+
+	return(scratch);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : readSector
+// Description  : reads one sector into "buf" through the cache
+//
+// Inputs       : trk - track of the sector
+//                sec - sector to read
+//                buf - sector sized buffer to read into
+// Outputs      : 0 if successful, -1 if failure
+
+int8_t readSector(int16_t trk, int16_t sec, char *buf){
+
+	// Find the contents, received straight into buf on a miss
+	char *data = fetchSector(trk, sec, buf, 0);
+	if(data == NULL){
+		return(-1);
+	}
+
+	// Copy a cache hit over
+	if(data != buf){
+		memcpy(buf, data, FS3_SECTOR_SIZE);
+	}
+
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : readSectorDisk
+// Description  : reads one sector from the controller, bypassing the cache
+//
+// Inputs       : trk - track of the sector
+//                sec - sector to read
+//                buf - sector sized buffer to read into
+// Outputs      : 0 if successful, -1 if failure
+
+int8_t readSectorDisk(int16_t trk, int16_t sec, char *buf){
+
+	// Local variables
+	FS3CmdBlk retCmd;
+
+	// Check track
+	if(switchTrack(trk) == -1){
+		return(-1);
+	}
+
+	// Read the sector from the controller
+	int netSuccess = network_fs3_syscall(construct_fs3_cmdblock(FS3_OP_RDSECT, sec ,0,0), &retCmd, buf);
+
+	// Deconstruct the command block to see if it worked properly (ret == 0) -> pass, (ret == 1) -> fail.
+	deconstruct_fs3_cmdblock(retCmd, &opval, &secval, &trkval, &retval);
+
+	// Read failed, bail
+	if(retval != 0 || netSuccess == -1){
+		logMessage(FS3DriverLLevel, "Read on track %d, sector %d failed, exiting program", trk, sec);
+		return(-1);
+	}
+	driverReads++;
+
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : prefetchSectors
+// Description  : reads sectors of one track into the cache as read ahead, sending
+//                a batch of reads down the pipeline and waiting for them once
+//
+// Inputs       : trk - track of the sectors
+//                secs - the sectors to read (none of them cached)
+//                n - number of sectors
+// Outputs      : 0 if successful, -1 if failure
+
+int8_t prefetchSectors(int16_t trk, int16_t *secs, int32_t n){
+
+	for(int32_t first = 0; first < n; first += FS3_DRIVER_BATCH){
+		int32_t len = (n - first < FS3_DRIVER_BATCH) ? n - first : FS3_DRIVER_BATCH;
+
+		for(int32_t i = 0; i < len; i++){
+			if(queueSectorDisk(trk, secs[first + i], driverBatchBuf[i], FS3_OP_RDSECT) == -1){
+				return(-1);
+			}
+		}
+		if(waitSectorsDisk() == -1){
+			return(-1);
+		}
+
+		for(int32_t i = 0; i < len; i++){
+			if(fs3_prefetch_cache(trk, secs[first + i], driverBatchBuf[i]) == -1){
+				return(-1);
+			}
+		}
+	}
+
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fillGroup
+// Description  : after a read miss, reads the other sectors of the file that
+//                sit in the missed sector's aligned group of the track into the
+//                cache (the ones not cached yet). The head is already on the
+//                track, so no seek is needed. Groups are cut down to a quarter
+//                of the cache so a fill cannot flush it.
+//
+// Inputs       : ofidx - open file index the miss was in
+//                fsec - file sector that missed
+// Outputs      : 0 if successful, -1 if failure
+
+int8_t fillGroup(int16_t ofidx, int32_t fsec){
+
+	// Local variables
+	int16_t secs[FS3_TRACK_SIZE]; // Sectors of the group to read
+	FS3OpenFile *of = &oftable[ofidx];
+	int16_t trk = of -> ofmap[fsec].strk;
+	int32_t group = fs3FillGroup;
+	int32_t first, filled = 0;
+
+	while(group > 1 && group > fs3_cache_lines() / 4){
+		group /= 2;
+	}
+	if(group <= 1){
 		return(0);
-	}else if(strncmp(ftable[fidx].fstate, "closed", 6) == 0){ // If the file is not open
-		// File is already closed / was never opened
-		logMessage(FS3DriverLLevel, "File refrenced by fh %d not open.", fd);
+	}
+	first = of -> ofmap[fsec].ssec & ~(group - 1);
+
+	// File sectors far enough away cannot be in the group
+	int32_t from = (fsec - group > 0) ? fsec - group : 0;
+	int32_t to   = (fsec + group < of -> numsec) ? fsec + group : of -> numsec;
+	for(int32_t f = from; f < to; f++){
+		int16_t sec = of -> ofmap[f].ssec;
+		if(f == fsec || of -> ofmap[f].strk != trk || sec < first || sec >= first + group || fs3_probe_cache(trk, sec)){
+			continue;
+		}
+		secs[filled++] = sec;
+	}
+
+	// Read them all at once
+	if(prefetchSectors(trk, secs, filled) == -1){
+		return(-1);
+	}
+	if(filled > 0){
+		driverFills++;
+		driverFillSectors += filled;
+	}
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : writeSectorDisk
+// Description  : writes one sector to the controller, bypassing the cache
+//
+// Inputs       : trk - track of the sector
+//                sec - sector to write
+//                buf - sector sized buffer to write from
+// Outputs      : 0 if successful, -1 if failure
+
+int8_t writeSectorDisk(int16_t trk, int16_t sec, char *buf){
+
+	// Local variables
+	FS3CmdBlk retCmd;
+
+	// Check track
+	if(switchTrack(trk) == -1){
+		return(-1);
+	}
+
+	// Write the sector to the controller
+	int netSuccess = network_fs3_syscall(construct_fs3_cmdblock(FS3_OP_WRSECT, sec, 0, 0), &retCmd, buf);
+
+	// Deconstruct the command block to see if it worked properly (ret == 0) -> pass, (ret == 1) -> fail.
+	deconstruct_fs3_cmdblock(retCmd, &opval, &secval, &trkval, &retval);
+
+	// Write failed, bail
+	if(retval != 0 || netSuccess == -1){
+		logMessage(FS3DriverLLevel, "Write on track %d, sector %d failed, exiting program", trk, sec);
+		return(-1);
+	}
+	driverWrites++;
+
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : queueSectorDisk
+// Description  : sends a sector read or write down the pipeline without waiting
+//                for it, seeking first (also pipelined) if the sector is on
+//                another track. Its buffer must be left alone until
+//                waitSectorsDisk returns.
+//
+// Inputs       : trk - track of the sector
+//                sec - sector to read or write
+//                buf - sector sized buffer to read into or write from
+//                op - FS3_OP_RDSECT or FS3_OP_WRSECT
+// Outputs      : 0 if successful, -1 if failure
+
+int8_t queueSectorDisk(int16_t trk, int16_t sec, char *buf, uint8_t op){
+
+	// The seek goes ahead of the sector, the server runs commands in order
+	if(trk != curTrk){
+		if(network_fs3_submit(construct_fs3_cmdblock(FS3_OP_TSEEK, 0, trk, 0), NULL) == -1){
+			logMessage(FS3DriverLLevel,"System call to seek to track %d failed, exiting program", trk);
+			return(-1);
+		}
+		driverSeekDistance += (curTrk < 0) ? 0 : abs(trk - curTrk);
+		curTrk = trk;
+		driverSeeks++;
+		driverQueued++;
+	}
+
+	if(network_fs3_submit(construct_fs3_cmdblock(op, sec, 0, 0), buf) == -1){
+		logMessage(FS3DriverLLevel, "Sending %s of track %d, sector %d failed, exiting program",
+			(op == FS3_OP_RDSECT) ? "read" : "write", trk, sec);
 		return(-1);
+	}
+	if(op == FS3_OP_RDSECT){
+		driverReads++;
 	}else{
+		driverWrites++;
+	}
+	driverQueued++;
 
-		////////////////////////////////////////////////////////////////
-		// 						SAVING NEW DATA                       //
-		////////////////////////////////////////////////////////////////
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : waitSectorsDisk
+// Description  : waits for every sector operation sent down the pipeline
+//
+// Inputs       : none
+// Outputs      : 0 if all of them succeeded, -1 if any failed
+
+int8_t waitSectorsDisk(void){
+
+	// Nothing was sent
+	if(driverQueued == 0){
+		return(0);
+	}
+	driverBatches++;
+	driverBatchOps += driverQueued;
+	driverQueued = 0;
+
+	if(network_fs3_wait(NULL) == -1){
+		logMessage(FS3DriverLLevel, "A pipelined batch of sector operations failed, exiting program");
+		return(-1);
+	}
+
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : writeSector
+// Description  : writes one sector through the cache, straight to the controller
+//                when the cache is write-through and only into the cache (dirty)
+//                when it is write-back
+//
+// Inputs       : trk - track of the sector
+//                sec - sector to write
+//                buf - sector sized buffer to write from
+// Outputs      : 0 if successful, -1 if failure
+
+int8_t writeSector(int16_t trk, int16_t sec, char *buf){
+
+	// Write-back, the sector reaches the disk when its cache line is flushed
+	if(fs3_cache_is_writeback()){
+		if(fs3_write_cache(trk, sec, buf) == -1){
+			logMessage(FS3DriverLLevel, "Failed to palce data in cache, exiting program");
+			return(-1);
+		}
+		return(0);
+	}
+
+	// Write the sector to the controller
+	if(writeSectorDisk(trk, sec, buf) == -1){
+		return(-1);
+	}
+
+	// Place data in the cache (write through)
+	if(fs3_put_cache(trk, sec, buf) == -1){
+		logMessage(FS3DriverLLevel, "Failed to palce data in cache, exiting program");
+		return(-1);
+	}
+
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : iovSpan
+// Description  : finds "len" bytes at offset "off" of the byte stream an iovec
+//                array describes, if they sit in a single segment
+//
+// Inputs       : iov - segments of the stream
+//                iovcnt - number of segments
+//                off - offset in the stream
+//                len - number of bytes
+// Outputs      : pointer to the bytes if they are contiguous, NULL if not
+
+char * iovSpan(const struct iovec *iov, int iovcnt, int32_t off, int32_t len){
+
+	// Walk to the segment holding off
+	for(int i = 0; i < iovcnt; i++){
+		if(off < (int32_t)iov[i].iov_len){
+			return((off + len <= (int32_t)iov[i].iov_len) ? (char *)iov[i].iov_base + off : NULL);
+		}
+		off -= iov[i].iov_len;
+	}
+
+	return(NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : iovCopy
+// Description  : copies "len" bytes between "data" and offset "off" of the byte 
+//                stream an iovec array describes
+//
+// Inputs       : iov - segments of the stream
+//                iovcnt - number of segments
+//                off - offset in the stream
+//                data - flat buffer on the other side of the copy
+//                len - number of bytes
+//                toIov - 1 to copy data into the stream, 0 to copy out of it
+// Outputs      : none
+
+void iovCopy(const struct iovec *iov, int iovcnt, int32_t off, char *data, int32_t len, int8_t toIov){
+
+	// Copy the piece that lands in each segment
+	for(int i = 0; i < iovcnt && len > 0; i++){
+
+		// Skip segments before off
+		if(off >= (int32_t)iov[i].iov_len){
+			off -= iov[i].iov_len;
+			continue;
+		}
+
+		int32_t piece = (int32_t)iov[i].iov_len - off;
+		if(piece > len){
+			piece = len;
+		}
+
+		if(toIov){
+			memcpy((char *)iov[i].iov_base + off, data, piece);
+		}else{
+			memcpy(data, (char *)iov[i].iov_base + off, piece);
+		}
+
+		data += piece;
+		len  -= piece;
+		off   = 0;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : elevatorNext
+// Description  : C-LOOK scheduler, picks the next track of a batch to serve: the
+//                first pending track at or above the current one, wrapping
+//                around to the lowest once the sweep passes the highest
+//
+// Inputs       : pending - one bit per track the batch still has work on
+// Outputs      : track to serve next, -1 when the batch is done
+
+int16_t elevatorNext(uint64_t pending){
+
+	// Local variables
+	int16_t cur = (curTrk < 0) ? 0 : curTrk;
+	uint64_t ahead = pending & (~0ULL << cur);
+
+	if(pending == 0){
+		return(-1);
+	}
+	return(__builtin_ctzll(ahead ? ahead : pending));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : scheduleBatch
+// Description  : counts a batch of sector operations in the scheduler statistics,
+//                the track changes its disk operations would have taken in arrival
+//                order against the seeks actually issued serving it. A batch served
+//                without going to the disk is not counted.
+//
+// Inputs       : arrivalSeeks - track changes of the disk operations in the order they came in
+//                issuedSeeks - track seeks sent to the controller for the batch
+// Outputs      : none
+
+void scheduleBatch(int32_t arrivalSeeks, int32_t issuedSeeks){
+
+	if(arrivalSeeks == 0 && issuedSeeks == 0){
+		return;
+	}
+
+	schedBatches++;
+	schedSeeksSaved += arrivalSeeks - issuedSeeks;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : planTracks
+// Description  : finds the tracks a request touches, for the elevator to visit
+//                once each, and the track changes its disk operations would take
+//                in file order
+//
+// Inputs       : ofidx - open file index of the request
+//                firstSec - first file sector of the request
+//                lastSec - one past the last file sector of the request
+//                misses - 1 if only sectors missing from the cache go to the disk
+//                *arrivalSeeks - where the track changes go, NULL to skip them
+// Outputs      : one bit per track
+
+uint64_t planTracks(int16_t ofidx, int32_t firstSec, int32_t lastSec, int8_t misses, int32_t *arrivalSeeks){
+
+	// Local variables
+	uint64_t tracks = 0;
+	int32_t seeks = 0;
+	int16_t last = curTrk;
+
+	// Only sectors the file owns have a location
+	if(lastSec > oftable[ofidx].numsec){
+		lastSec = oftable[ofidx].numsec;
+	}
+
+	for(int32_t fsec = firstSec; fsec < lastSec; fsec++){
+		int16_t trk = oftable[ofidx].ofmap[fsec].strk;
+		tracks |= (uint64_t)1 << trk;
+		if(trk != last && !(misses && fs3_probe_cache(trk, oftable[ofidx].ofmap[fsec].ssec))){
+			seeks++;
+			last = trk;
+		}
+	}
+
+	if(arrivalSeeks != NULL){
+		*arrivalSeeks = seeks;
+	}
+	return(tracks);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : extendFile
+// Description  : allocates sectors so an open file covers the first "end" bytes
+//
+// Inputs       : ofidx - open file index to extend
+//                fidx - permanant file index of the same file
+//                end - length the file has to reach
+// Outputs      : 0 if successful, -1 if failure
+
+int8_t extendFile(int16_t ofidx, int16_t fidx, int32_t end){
+
+	// Local variables
+	int16_t trkidx = -1; // Index of the next free track location
+	int16_t secidx = -1; // Index of the next free sector location
+
+	// Only update length if the position is going to go past the current length
+	if(end <= oftable[ofidx].oflength){ 
+		return(0);
+	}
+
+	//Log info
+	logMessage(FS3DriverLLevel, "Extending file length... fh %d length is now %d", oftable[ofidx].ofhandle, end);
+
+	// Compute number of new sectors required (can only allocate full sectors)
+	int32_t requiredSectors = (end + FS3_SECTOR_SIZE - 1) / FS3_SECTOR_SIZE;
+
+	// Check if the file requires another sector  
+	if(requiredSectors <= oftable[ofidx].numsec){ 
+		return(0);
+	}
+
+	// How many sectors to add (required sectors - how many sectors are alredy allocated)
+	int32_t numSectors = requiredSectors - (oftable[ofidx].numsec);
+
+	// Log info
+	logMessage(FS3DriverLLevel, "Required sectors for the file exceeds currently allocated sectors, allocating %d more sectors for fh %d", numSectors, oftable[ofidx].ofhandle);
+
+	// While the required sectors have not been allocated
+	while(numSectors > 0){
+
+		// Find a run of contiguous free track/setor combinations
+		int16_t runLen = allocSectors(fidx, oftable[ofidx].numsec, numSectors, &trkidx, &secidx);
+
+		// Check for failure
+		if(runLen == -1){
+			return(-1);
+		}
+
+		// Update local/global locations (also increments the number of sectors)
+		for(int k = 0; k < runLen; k++){
+			if(addFileSector(ofidx, trkidx, secidx + k) == -1){
+				return(-1);
+			}
+		}
 
-		ftable[fidx].flength = oftable[ofidx].oflength;  // Record new metadata into permanent table
-		ftable[fidx].numsec = oftable[ofidx].numsec;     // Record new metadata
-		strcpy(ftable[fidx].fstate, "closed"); 	 		 // Set the file to closed
+		// Decrement numSectors
+		numSectors -= runLen;
+	}
 
-		// Save all track/sector combinations
-		memcpy(&ftable[fidx].floc[0][0], &oftable[ofidx].ofloc[0][0], sizeof(oftable[freeOFile].ofloc[0][0])*FS3_MAX_TRACKS*FS3_TRACK_SIZE);
+	// Initial update of length
+	oftable[ofidx].oflength = oftable[ofidx].numsec*FS3_SECTOR_SIZE;
+	return(0);
+}
 
-		////////////////////////////////////////////////////////////////
-		// 				RESET ALL OPEN FILE PARAMETERS                //
-		////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : prefetchTrack
+// Description  : reads the file sectors in [firstSec, lastSec) that sit on one
+//                track and are not cached into the cache
+//
+// Inputs       : ofidx - open file index to read ahead in
+//                trk - the track being served
+//                firstSec - first file sector to read ahead
+//                lastSec - one past the last file sector to read ahead
+// Outputs      : 0 if successful, -1 if failure
 
-		oftable[ofidx].oflength =  0; // Set back to original value
-		oftable[ofidx].ofhandle = -1; // Set back to original value
-		oftable[ofidx].ofpos    =  0; // Set back to original value
-		oftable[ofidx].numsec   =  0; // Set back to original value
-	
-		// Set track/sectors to all 0's
-		memset(&oftable[ofidx].ofloc[0][0], 0x0, sizeof(oftable[freeOFile].ofloc[0][0])*FS3_MAX_TRACKS*FS3_TRACK_SIZE);
+int8_t prefetchTrack(int16_t ofidx, int16_t trk, int32_t firstSec, int32_t lastSec){
 
-		// Log info
-		logMessage(FS3DriverLLevel, "File contents of fh %d, [%s] saved.", fd, ftable[fidx].fname);
-		return (0); // Return 0 to indicate success
+	// Local variables
+	int16_t secs[FS3_TRACK_SIZE]; // Sectors of the window on this track
+	int32_t n = 0;
+
+	// Every sector of the window on this track that is not cached yet, read at once
+	for(int32_t fsec = firstSec; fsec<lastSec; fsec++){
+		int16_t sec = oftable[ofidx].ofmap[fsec].ssec;
+		if(oftable[ofidx].ofmap[fsec].strk != trk || fs3_probe_cache(trk, sec)){
+			continue;
+		}
+		secs[n++] = sec;
 	}
+
+	return(prefetchSectors(trk, secs, n));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : fs3_read
-// Description  : Reads "count" bytes from the file handle "fh" into the 
-//                buffer "buf"
+// Function     : readAhead
+// Description  : detects sequential reads of an open file and keeps a window of
+//                the sectors after them in the cache. The window starts small and
+//                doubles each time the reader gets into its second half, up to
+//                the readahead limit (and a quarter of the cache). Only picks the
+//                window, the read serves it track by track with its own sectors.
 //
-// Inputs       : fd - filename of the file to read from
-//                buf - pointer to buffer to read into
-//                count - number of bytes to read
-// Outputs      : bytes read if successful, -1 if failure
+// Inputs       : ofidx - open file index about to be read
+//                pos - position the read starts at
+//                count - bytes to read
+//                raFrom - set to the first file sector to read ahead
+//                raTo - set to one past the last one (raFrom if there is none)
+// Outputs      : none
 
-int32_t fs3_read(int16_t fd, void *buf, int32_t count) {
+void readAhead(int16_t ofidx, int32_t pos, int32_t count, int32_t *raFrom, int32_t *raTo){
 
-	// Variables for file tracking
-	int16_t fidx        = -1; // Index of the permanant file corresponding to the file handle
-	int16_t ofidx       = -1; // Index of the open file corresponding to the file handle
-	int16_t idxRet      = -1; // Initial value
+	// Local variables
+	FS3OpenFile *of  = &oftable[ofidx];
+	int32_t firstSec = pos / FS3_SECTOR_SIZE;
+	int32_t lastSec  = (pos + count + FS3_SECTOR_SIZE - 1) / FS3_SECTOR_SIZE; // One past the last sector read
+	int32_t maxSize  = (fs3ReadAheadMax < fs3_cache_lines() / 4) ? fs3ReadAheadMax : fs3_cache_lines() / 4;
+	int8_t sequential = (firstSec == of -> ofranext);
+
+	// A sequential read starts in the sector the last one ended in
+	of -> ofranext = (pos + count) / FS3_SECTOR_SIZE;
+	*raFrom = *raTo = 0;
+
+	// Random reads (or no room for a window) stop any readahead
+	if(!sequential || maxSize < FS3_READAHEAD_INIT){
+		of -> ofrasize = 0;
+		of -> ofraend  = 0;
+		return;
+	}
 
-	// Variables for tracking the state of the read call
-	int32_t writePos     =  0; // Tracks the position to write into readBuf 
-	int32_t sectorsRead  =  0; // Number of sectors that have already been read
-	int16_t numToRead = (int)ceil((double)count/(double)1024);
+	// First sequential read, open a small window right after it
+	if(of -> ofrasize == 0){
+		of -> ofrasize = FS3_READAHEAD_INIT;
+	}
+	if(of -> ofraend < lastSec){
+		of -> ofraend = lastSec;
+	}
 
-	// Buffers
-	char *readBuf, *cachePtr; 
-	char *tmpBuf = (char*)malloc(FS3_SECTOR_SIZE); 
+	// Still more than half a window read ahead of the reader
+	if(lastSec + of -> ofrasize / 2 <= of -> ofraend || of -> ofraend >= of -> numsec){
+		return;
+	}
 
-	idxRet = idxByHandle(fd, &ofidx, &fidx); // Get file indexes
+	// Read the next window in, then let the one after it be twice as big
+	int32_t from = of -> ofraend;
+	int32_t to   = (from + of -> ofrasize < of -> numsec) ? from + of -> ofrasize : of -> numsec;
+	logMessage(FS3DriverLLevel, "Reading ahead sectors %d-%d of fh %d", from, to - 1, of -> ofhandle);
+	of -> ofraend  = to;
+	of -> ofrasize = (of -> ofrasize * 2 < maxSize) ? of -> ofrasize * 2 : maxSize;
+
+	*raFrom = from;
+	*raTo   = to;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : readvAt
+// Description  : Reads the bytes at position "pos" of an open file into the 
+//                buffers of "iov", without touching the file position
+//
+// Inputs       : ofidx - open file index to read from
+//                iov - buffers to read into, filled in order
+//                iovcnt - number of buffers
+//                pos - position in the file to read from
+//                sequential - 1 if the read continues the handle's stream, so it
+//                             updates and uses the handle's readahead window
+// Outputs      : bytes read if successful, -1 if failure
 
-	// Allocate space for readBuf
-	readBuf = (char*)malloc(numToRead*FS3_SECTOR_SIZE); // Willw always be a multiple of 1024
+int32_t readvAt(int16_t ofidx, const struct iovec *iov, int iovcnt, int32_t pos, int8_t sequential) {
 
-	// Clear memory
-	memset(tmpBuf, 0x0, FS3_SECTOR_SIZE);
-	memset(readBuf, 0x0, numToRead*FS3_SECTOR_SIZE);
+	// Buffers
+	char sectorBuf[FS3_SECTOR_SIZE]; // Receives partially read sectors that miss the cache
+	char scratch[FS3_READ_SCRATCH][FS3_SECTOR_SIZE]; // Receive pipelined reads of partial sectors
+	char *data;                      // Contents of the sector being read
+	char *dst;                       // Place in the buffers the sector lands, if contiguous
+	int32_t pendSec[FS3_DRIVER_BATCH]; // File sectors of a batch read down the pipeline
+	char *pendBuf[FS3_DRIVER_BATCH];   // Where each of them was received
+
+	// Total size of the request
+	int32_t count = 0;
+	for(int i = 0; i < iovcnt; i++){
+		count += iov[i].iov_len;
+	}
+
+	int32_t firstSec = pos / FS3_SECTOR_SIZE;
+	int32_t lastSec  = (pos + count + FS3_SECTOR_SIZE - 1) / FS3_SECTOR_SIZE; // One past the last sector
 
 	////////////////////////////////////////////////////////////////
-	// 						FAILURE CONTITIONS                    //
+	// 	       ZERO WHAT LIES PAST THE SECTORS THE FILE OWNS       //
 	////////////////////////////////////////////////////////////////
 
-	if(ofidx == -1 || fidx == -1){ // End the program if the file is not found in either structure
-		logMessage(FS3DriverLLevel, "Failed to find file index, exiting program");
-		return(-1);  
-	}else if(strcmp(ftable[fidx].fstate, "opened") != 0){ // End the program if the file is  not open
-		logMessage(FS3DriverLLevel, "File not opened, exiting program");
-		return(-1);  
-	}else if(tmpBuf == NULL){ // End program if allocation failed
-		logMessage(FS3DriverLLevel,"Memory allocation for tmpBuf failed, exiting program");
-		return(-1);
-	}else if(readBuf == NULL){ // Check for success
-		logMessage(FS3DriverLLevel,"Memory allocation for readBuf failed, exiting program");
-		return(-1); 
-	}else if(idxRet == -1){ // Check for success
-		logMessage(FS3DriverLLevel,"Failed to find file index, exiting program.");
-		return(-1); 
+	int32_t ownedEnd = oftable[ofidx].numsec*FS3_SECTOR_SIZE;
+	if(pos + count > ownedEnd){
+		int32_t zeroFrom = (pos > ownedEnd) ? pos : ownedEnd;
+		memset(sectorBuf, 0x0, FS3_SECTOR_SIZE);
+		for(int32_t off = zeroFrom; off < pos + count; off += FS3_SECTOR_SIZE){
+			int32_t len = (pos + count - off < FS3_SECTOR_SIZE) ? pos + count - off : FS3_SECTOR_SIZE;
+			iovCopy(iov, iovcnt, off - pos, sectorBuf, len, 1);
+		}
 	}
 
 	////////////////////////////////////////////////////////////////
-	// 				   READ WHOLE FILE CONTENTS                   //
+	// 	  READ EACH SECTOR STRAIGHT INTO THE BUFFERS, BY TRACK     //
 	////////////////////////////////////////////////////////////////
 
-	int sectorsChecked = 0;
-	int firstSec = (int)floor((double)oftable[ofidx].ofpos / (double)FS3_SECTOR_SIZE);
-
-	// Only read if there is data
-	if(numToRead > 0){
+	// Sequential readers also get sectors read ahead, on the same pass over the tracks
+	int32_t raFrom = 0, raTo = 0;
+	if(fs3ReadAheadMax > 0 && sequential){
+		readAhead(ofidx, pos, count, &raFrom, &raTo);
+	}
+	int32_t planEnd = (raTo > lastSec) ? raTo : lastSec;
+
+	// Tracks are only seeked to for sectors that miss the cache, each one once, in elevator order
+	int32_t arrivalSeeks, issuedSeeks = driverSeeks;
+	uint64_t pending = planTracks(ofidx, firstSec, planEnd, 1, &arrivalSeeks);
+	for(int16_t trk = elevatorNext(pending); trk != -1; trk = elevatorNext(pending)){
+
+		// Serve the sectors of the request on this track a batch at a time
+		int32_t end = (lastSec < oftable[ofidx].numsec) ? lastSec : oftable[ofidx].numsec;
+		int32_t next;
+		for(int32_t batch = firstSec; batch < end; batch = next){
+
+			// Send a read down the pipeline for each sector of the batch that is not cached
+			int32_t npend = 0, nscratch = 0;
+			for(next = batch; next < end && npend < FS3_DRIVER_BATCH; next++){
+				int sec = oftable[ofidx].ofmap[next].ssec;
+				if(oftable[ofidx].ofmap[next].strk != trk || fs3_probe_cache(trk, sec)){
+					continue;
+				}
 
-		// Loop through all locations of the currently opened file
-		for(int trk = 0; trk<FS3_MAX_TRACKS; trk++){
+				// Whole sectors are received straight into a buffer, partial ones into scratch
+				int32_t secStart = next*FS3_SECTOR_SIZE;
+				char *into = (pos <= secStart && pos + count >= secStart + FS3_SECTOR_SIZE) ?
+					iovSpan(iov, iovcnt, secStart - pos, FS3_SECTOR_SIZE) : NULL;
+				if(into == NULL){
+					if(nscratch == FS3_READ_SCRATCH){
+						break; // Serve what was sent first, this sector starts the next batch
+					}
+					into = scratch[nscratch++];
+				}
 
-			if(sectorsRead == numToRead){ // Cascades from sector for loop below
-				break;
+				if(queueSectorDisk(trk, sec, into, FS3_OP_RDSECT) == -1){
+					return(-1);
+				}
+				pendSec[npend]   = next;
+				pendBuf[npend++] = into;
+			}
+			if(waitSectorsDisk() == -1){
+				return(-1);
 			}
 
-			// Check every sector in each track
-			for(int sec = 0; sec<FS3_TRACK_SIZE; sec++){
+			// The reads have landed, serve the batch in order
+			for(int32_t fsec = batch, p = 0; fsec < next; fsec++){
 
-				if(sectorsRead == numToRead){ // breakout condition
-					break;
+				// Location of the sector
+				if(oftable[ofidx].ofmap[fsec].strk != trk){
+					continue;
+				}
+				int sec = oftable[ofidx].ofmap[fsec].ssec;
+
+				// Part of the sector that lands in the buffers, and where it lands
+				int32_t secStart = fsec*FS3_SECTOR_SIZE;
+				int32_t from     = (pos > secStart) ? pos - secStart : 0;
+				int32_t to       = (pos + count < secStart + FS3_SECTOR_SIZE) ? pos + count - secStart : FS3_SECTOR_SIZE;
+				dst              = iovSpan(iov, iovcnt, secStart + from - pos, to - from);
+
+				// A sector read down the pipeline is ready, any other miss (evicted since) is read now
+				int8_t ready = (p < npend && pendSec[p] == fsec);
+				data = fetchSector(trk, sec, ready ? pendBuf[p++] :
+					((from == 0 && to == FS3_SECTOR_SIZE && dst != NULL) ? dst : sectorBuf), ready);
+				if(data == NULL){
+					return(-1);
 				}
+				fs3_trace_record(FS3_TRACE_READ, trk, sec, oftable[ofidx].ofhandle, to - from);
 
-				// Check to see if the sector has any information in it
-				if(oftable[ofidx].ofloc[trk][sec] == 1){
-					
-					// If the nuymber of sectors in the file == number of sectors read, exit the loop
-					if(sectorsChecked == firstSec){
-
-						// Check if its on the correct track
-						if(trk != curTrk){
-							// Switch to the correct track
-							int8_t switchRet = switchTrack(trk); // Failing here
-
-							if(switchRet == -1){
-								return(-1);
-							}
-						}
-
-						// Give cacheBuf a value
-						cachePtr = fs3_get_cache(trk, sec);
-
-						// Check to see if it was found
-						if(cachePtr != NULL){ // Cache line was found
-							// Copy data over
-							memcpy(&readBuf[writePos], cachePtr, FS3_SECTOR_SIZE); //ERROR (8 bytes = a pointer)
-
-						}else{ // Cache line not found
-							// Local variable
-							FS3CmdBlk retCmd;
-
-							logMessage(FS3DriverLLevel, "[trk = %d, sec = %d] not found in cache", trk, sec);
-							
-							// Read the 'ith' sector worth of information
-							int netSuccess = network_fs3_syscall(construct_fs3_cmdblock(FS3_OP_RDSECT, sec ,0,0), &retCmd, tmpBuf);
-
-							// Deconstruct the command block to see if it worked properly (ret == 0) -> pass, (ret == 1) -> fail.
-							deconstruct_fs3_cmdblock(retCmd, &opval, &secval, &trkval, &retval);
-
-							// Read failed, bail
-							if(retval != 0 || netSuccess == -1){
-								logMessage(FS3DriverLLevel, "Read on track %d, sector %d failed, exiting program", trk, sec);
-								return(-1);
-							}
-							
-							// Place data in the cache
-							int putRet = fs3_put_cache(trk, sec, tmpBuf);
-
-							if(putRet == -1){
-								logMessage(FS3DriverLLevel, "Failed to palce data in cache, exiting program");
-								return(-1);
-							}
-
-							// Copy a sector worth of old content into the write buf
-							memcpy(&readBuf[writePos], tmpBuf, FS3_SECTOR_SIZE);
-						}
-
-						// Update
-						writePos += FS3_SECTOR_SIZE;
-						sectorsRead++;
-					}else{
-						sectorsChecked++;
-					}
+				// Copy the wanted bytes from the cache line (or the partial sector)
+				if(data != dst){
+					iovCopy(iov, iovcnt, secStart + from - pos, data + from, to - from, 1);
 				}
-			} 
-		} 
-	}
+			}
 
-	////////////////////////////////////////////////////////////////
-	// 				   COPY CORRECT AMMOUNT OVER                  //
-	////////////////////////////////////////////////////////////////
+			// The rest of each missed sector's group comes along while the track is under the head
+			for(int32_t p = 0; p < npend && fs3FillGroup > 1; p++){
+				if(fillGroup(ofidx, pendSec[p]) == -1){
+					return(-1);
+				}
+			}
+		}
 
-	// Copy over memory to buf
-	memcpy(buf, readBuf, count); 
+		// Then whatever the readahead window has on this track
+		if(raTo > raFrom && prefetchTrack(ofidx, trk, raFrom, raTo) == -1){
+			return(-1);
+		}
 
-	// Log info
-	logMessage(FS3DriverLLevel, "FS3 DRVR: read on fh %d (%d bytes)", oftable[ofidx].ofhandle, count);
+		pending &= ~((uint64_t)1 << trk);
+	}
+	scheduleBatch(arrivalSeeks, driverSeeks - issuedSeeks);
 
-	// Free memory
-	free(tmpBuf);
-	free(readBuf);
+	// Let the cache size itself between operations
+	if(fs3_cache_autotune() == -1){
+		return(-1);
+	}
 
-	// Good practice
-	tmpBuf   = NULL;
-	readBuf  = NULL;
-	cachePtr = NULL; // Never malloced, just ned to reset value
+	// Log info
+	logMessage(FS3DriverLLevel, "FS3 DRVR: read on fh %d (%d bytes at %d)", oftable[ofidx].ofhandle, count, pos);
 	return(count);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : fs3_write
-// Description  : Writes "count" bytes to the file handle "fh" from the 
-//                buffer  "buf"
+// Function     : writevAt
+// Description  : Writes the buffers of "iov" at position "pos" of an open file, 
+//                growing it as needed, without touching the file position
 //
-// Inputs       : fd - filename of the file to write to
-//                buf - pointer to buffer to write from
-//                count - number of bytes to write
+// Inputs       : ofidx - open file index to write to
+//                fidx - permanant file index of the same file
+//                iov - buffers to write from, taken in order
+//                iovcnt - number of buffers
+//                pos - position in the file to write at
 // Outputs      : bytes written if successful, -1 if failure
 
-int32_t fs3_write(int16_t fd, void *buf, int32_t count) { //buf -> data that shoud be written
-
-	// Variables for file / open location tracking
-	int16_t fidx     = -1; // Index of the permanant file corresponding to the file handle
-	int16_t ofidx    = -1; // Index of the open file corresponding to the file handle
-	int16_t trkidx   = -1; // Index of the next free track location
-	int16_t secidx   = -1; // Index of the next free sector location
-	int16_t idxRet   = -1; // Initial value
-
-	// Variables for tracking the state of the write call
-	int32_t writePos     =  0; // Keeps track of where to write from
-	int32_t writeBufSize =  0; // Selects what size writeBuf should be between 'length' and 'pos + count'
-	int32_t sectorsWrote =  0; // Number of sectors that have already been wrote
+int32_t writevAt(int16_t ofidx, int16_t fidx, const struct iovec *iov, int iovcnt, int32_t pos) {
 
 	// Buffers 
-	char *writeBuf, *cachePtr, *tmpBuf;
+	char sectorBuf[FS3_SECTOR_SIZE]; // Contents of the sector being written
+	char *src;                       // Place in the buffers the sector comes from, if contiguous
+
+	// Total size of the request
+	int32_t count = 0;
+	for(int i = 0; i < iovcnt; i++){
+		count += iov[i].iov_len;
+	}
 
-	// Returns the open/permanant file index of a file referd to by the given file handle
-	idxRet = idxByHandle(fd, &ofidx, &fidx); 
+	// End the program if the write is larger than the max file size(10KB)
+	if(MAX_FILE_SIZE < (pos + count)){ 
+		logMessage(FS3DriverLLevel, "Write size in [WRITE] excedded the limit, exiting program");
+		return(-1);
+	}
 
 	// Find the first sector that needs to be changed
-	int16_t firstSec = (int)floor((double)oftable[ofidx].ofpos / (double)1024);
+	int32_t firstSec = pos / FS3_SECTOR_SIZE;
 	
-	// Find the last sector that needs to be changed
-	int16_t lastSec = (int)ceil((double)(oftable[ofidx].ofpos + count) / (double)1024);
-
-	// Determine how many sectors need to be changed
-	int16_t numToChange = lastSec - firstSec;
-
-	// Determine the correct size for writeBuf
-	writeBufSize = numToChange*FS3_SECTOR_SIZE;
-
-	// Dynamically allocates area of oflength in memory to store the file
-	writeBuf = (char*)malloc(writeBufSize);
-	tmpBuf   = (char*)malloc(FS3_SECTOR_SIZE);
+	// Find the last sector that needs to be changed (one past it)
+	int32_t lastSec = (pos + count + FS3_SECTOR_SIZE - 1) / FS3_SECTOR_SIZE;
 
-	// Clear memory
-	memset(writeBuf, 0x0, writeBufSize);
-	memset(tmpBuf, 0x0, FS3_SECTOR_SIZE);
+	// Remember which sectors already held data, then allocate any new ones
+	int32_t oldNumsec = oftable[ofidx].numsec;
+	if(extendFile(ofidx, fidx, pos + count) == -1){
+		return(-1);
+	}
 
 	////////////////////////////////////////////////////////////////
-	// 						FAILURE CONTITIONS                    //
+	// 	 BUILD EACH SECTOR AND WRITE IT BY TRACK (READ WHEN NEEDED) //
 	////////////////////////////////////////////////////////////////
 
-	if(ofidx == -1 || fidx == -1){ // End the program if the file is not found in either structure
-		logMessage(FS3DriverLLevel, "File index not found in [WRITE] exiting program");
-		return(-1);
-	}else if(strcmp(ftable[fidx].fstate, "opened") != 0){ // End the program if the file is found but not open
-		logMessage(FS3DriverLLevel, "File not opened in [WRITE] exiting program");
-		return(-1);
-	}else if(MAX_FILE_SIZE < (oftable[ofidx].ofpos + count)){ // End the program if the write is larger than the max file size(10KB)
-	logMessage(FS3DriverLLevel, "Write size in [WRITE] excedded the limit, exiting program");
-		return(-1);
-	}else if(tmpBuf == NULL){ // If tmpBuf == NULL (malloc() failed)
-		logMessage(FS3DriverLLevel,"Memory allocation for tmpBuf failed in [WRITE], exiting program");
-		return(-1); // Failed 
-	}else if(writeBuf == NULL){
-		logMessage(FS3DriverLLevel,"Memory allocation for writeBuf failed in [WRITE], exiting program");
-		return(-1);
-	}else if(idxRet == -1){
-		logMessage(FS3DriverLLevel,"File index not found in [WRITE], exiting program");
-		return(-1);
+	// Write-through sends every sector to the disk, write-back only reads the
+	// partly written ones that hold data and are not cached
+	int32_t arrivalSeeks = 0, issuedSeeks = driverSeeks;
+	uint64_t pending = planTracks(ofidx, firstSec, lastSec, 0, fs3_cache_is_writeback() ? NULL : &arrivalSeeks);
+	if(fs3_cache_is_writeback()){
+		int32_t edges[2] = {firstSec, lastSec - 1}; // Only the first and last sector can be partly written
+		int16_t last = curTrk;
+		for(int e = 0; e < 2 && (e == 0 || edges[1] != edges[0]); e++){
+			int32_t secStart = edges[e]*FS3_SECTOR_SIZE;
+			int16_t trk = oftable[ofidx].ofmap[edges[e]].strk;
+			if((pos > secStart || pos + count < secStart + FS3_SECTOR_SIZE) && edges[e] < oldNumsec &&
+			   !fs3_probe_cache(trk, oftable[ofidx].ofmap[edges[e]].ssec) && trk != last){
+				arrivalSeeks++;
+				last = trk;
+			}
+		}
 	}
+	for(int16_t trk = elevatorNext(pending); trk != -1; trk = elevatorNext(pending)){
 
-	////////////////////////////////////////////////////////////////
-	// 		  READ ALL SECTORS FROM THE FILE INTO WRITEBUF        //
-	////////////////////////////////////////////////////////////////
-	
-	// Only update length if the position is going to go past the current length
-	if(oftable[ofidx].ofpos + count > oftable[ofidx].oflength){ 
+		// Serve every sector of the request on this track
+		for(int32_t fsec = firstSec; fsec<lastSec && fsec<oftable[ofidx].numsec; fsec++){ 
+
+			// Location of the sector
+			if(oftable[ofidx].ofmap[fsec].strk != trk){
+				continue;
+			}
+			int sec = oftable[ofidx].ofmap[fsec].ssec;
+
+			// Part of the sector covered by the buffers
+			int32_t secStart = fsec*FS3_SECTOR_SIZE;
+			int32_t from     = (pos > secStart) ? pos - secStart : 0;
+			int32_t to       = (pos + count < secStart + FS3_SECTOR_SIZE) ? pos + count - secStart : FS3_SECTOR_SIZE;
+			src              = iovSpan(iov, iovcnt, secStart + from - pos, to - from);
+
+			// A sector overwritten completely from one buffer is written from it directly
+			if(from == 0 && to == FS3_SECTOR_SIZE && src != NULL){
+				if(writeSector(trk, sec, src) == -1){
+					logMessage(FS3DriverLLevel,"System call to write to sector %d for fh %d failed, exiting program", sec, oftable[ofidx].ofhandle);
+					return(-1);
+				}
+				fs3_trace_record(FS3_TRACE_WRITE, trk, sec, oftable[ofidx].ofhandle, to - from);
+				continue;
+			}
+
+			// Fill in the bytes the buffers do not cover
+			if(from == 0 && to == FS3_SECTOR_SIZE){
+				// Sector is overwritten completely, the old contents do not matter
+			}else if(fsec >= oldNumsec){
+				// Sector was just allocated and has never been written, it is known to be zero
+				memset(sectorBuf, 0x0, FS3_SECTOR_SIZE);
+			}else{
+				// Sector holds live bytes around the new ones, read it first
+				int8_t missed = (fs3FillGroup > 1 && !fs3_probe_cache(trk, sec));
+				if(readSector(trk, sec, sectorBuf) == -1 || (missed && fillGroup(ofidx, fsec) == -1)){
+					logMessage(FS3DriverLLevel, "Read in [WRITE] Failed, exiting program");
+					return(-1);
+				}
+				fs3_trace_record(FS3_TRACE_READ, trk, sec, oftable[ofidx].ofhandle, to - from);
+			}
+
+			// Move the new data into the sector
+			iovCopy(iov, iovcnt, secStart + from - pos, &sectorBuf[from], to - from, 0);
 
-		//Log info
-		logMessage(FS3DriverLLevel, "Extending file length to accomadate %d bytes... fh %d length is now %d", 
-			count, oftable[ofidx].ofhandle, (oftable[ofidx].ofpos + count));
+			// Write the sector out
+			if(writeSector(trk, sec, sectorBuf) == -1){
+				logMessage(FS3DriverLLevel,"System call to write to sector %d for fh %d failed, exiting program", sec, oftable[ofidx].ofhandle);
+				return(-1);
+			}
+			fs3_trace_record(FS3_TRACE_WRITE, trk, sec, oftable[ofidx].ofhandle, to - from);
+		}
 
-		// Compute number of new sectors required
-		double requiredSectors = ceil((double)(oftable[ofidx].ofpos + count) / (double)FS3_SECTOR_SIZE); // Can only allocate full sectors
+		pending &= ~((uint64_t)1 << trk);
+	}
+	scheduleBatch(arrivalSeeks, driverSeeks - issuedSeeks);
 
-		// Check if the file requires another sector  
-		if(requiredSectors > oftable[ofidx].numsec){ 
+	// Let the background flusher catch up now that the request is done
+	if(fs3_flush_cache_watermark() == -1){
+		return(-1);
+	}
 
-			// How many sectors to add (required sectors - how many sectors are alredy allocated)
-			int8_t numSectors = requiredSectors - (oftable[ofidx].numsec);
+	// Let the cache size itself between operations
+	if(fs3_cache_autotune() == -1){
+		return(-1);
+	}
 
-			// Log info
-			logMessage(FS3DriverLLevel, "Required sectors for the file exceeds currently allocated sectors, allocating %d more sectors for fh %d", numSectors, oftable[ofidx].ofhandle);
+	// Log info
+	logMessage(FS3DriverLLevel, "FS3 DRVR: write on fh %d (%d bytes at %d) [len=%d]",
+		oftable[ofidx].ofhandle, count, pos, oftable[ofidx].oflength);
 
-			// While the required sectors have not been allocated
-			while(numSectors > 0){
+	// Indicate success
+	return(count);
+}
 
-				// Find a free track/setor combination
-				findFreeLoc(&trkidx, &secidx);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_read
+// Description  : Reads "count" bytes from the file handle "fh" into the 
+//                buffer "buf"
+//
+// Inputs       : fd - filename of the file to read from
+//                buf - pointer to buffer to read into
+//                count - number of bytes to read
+// Outputs      : bytes read if successful, -1 if failure
 
-				// Update local/global locations
-				oftable[ofidx].ofloc[trkidx][secidx] = 1;
+int32_t fs3_read(int16_t fd, void *buf, int32_t count) {
 
-				// Decrement numSectors
-				numSectors--;
+	// Variables for file tracking
+	int16_t fidx  = -1; // Index of the permanant file corresponding to the file handle
+	int16_t ofidx = -1; // Index of the open file corresponding to the file handle
 
-				// Increment number of sectors
-				oftable[ofidx].numsec++;
-			}
+	// Find the open file
+	if(openedByHandle(fd, &ofidx, &fidx) == -1){
+		return(-1);
+	}
 
-			// Initial update of length
-			oftable[ofidx].oflength = oftable[ofidx].numsec*FS3_SECTOR_SIZE;
-		}
+	// Read at the current position
+	struct iovec one = { buf, count };
+	if(readvAt(ofidx, &one, 1, oftable[ofidx].ofpos, 1) == -1){
+		return(-1);
 	}
 
-	// Only read if theres data to read
-	if(numToChange > 0 && oftable[ofidx].oflength != 0){
-	    
-		// Save old position for later
-		int32_t tmpPos  = oftable[ofidx].ofpos;
+	// Update the new position
+	oftable[ofidx].ofpos += count;
+	return(count);
+}
 
-		// Set position to 0 in order to read the whole file
-		oftable[ofidx].ofpos = firstSec*FS3_SECTOR_SIZE;
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_write
+// Description  : Writes "count" bytes to the file handle "fh" from the 
+//                buffer  "buf"
+//
+// Inputs       : fd - filename of the file to write to
+//                buf - pointer to buffer to write from
+//                count - number of bytes to write
+// Outputs      : bytes written if successful, -1 if failure
 
-		// Read sectors that need to be altered
-		int32_t readRes = fs3_read(fd, writeBuf, writeBufSize); // Reads the whole sector
+int32_t fs3_write(int16_t fd, void *buf, int32_t count) { //buf -> data that shoud be written
 
-		// Check for success
-		if(readRes != writeBufSize){
-			logMessage(FS3DriverLLevel, "Read in [WRITE] Failed, exiting program");
-			return(-1);
-		}
+	// Variables for file tracking
+	int16_t fidx  = -1; // Index of the permanant file corresponding to the file handle
+	int16_t ofidx = -1; // Index of the open file corresponding to the file handle
 
-		// Return file position to previous state
-		oftable[ofidx].ofpos = tmpPos;
+	// Find the open file
+	if(openedByHandle(fd, &ofidx, &fidx) == -1){
+		return(-1);
 	}
 
-	////////////////////////////////////////////////////////////////
-	// 		  ADD CONTENTS OF BUF INTO THE CURRENT POSITION       //
-	////////////////////////////////////////////////////////////////
-
-	// Determine where to write on the new writeBuf
-	int whereToWrite = oftable[ofidx].ofpos - (firstSec*FS3_SECTOR_SIZE);
+	// Write at the current position
+	struct iovec one = { buf, count };
+	if(writevAt(ofidx, fidx, &one, 1, oftable[ofidx].ofpos) == -1){
+		return(-1);
+	}
 
-	logMessage(FS3DriverLLevel, "WhereToWrite = %d, Pos = %d, firstSec = %d", whereToWrite,oftable[ofidx].ofpos, firstSec);
+	// Update the new position
+	oftable[ofidx].ofpos += count;
+	return(count);
+}
 
-	// Move buf data into writeBuf at the current position
-	memcpy(&writeBuf[whereToWrite], buf, count);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_pread
+// Description  : Reads "count" bytes at offset "off" of the file handle "fh" 
+//                into the buffer "buf", leaving the file position and the
+//                readahead window alone
+//
+// Inputs       : fd - filename of the file to read from
+//                buf - pointer to buffer to read into
+//                count - number of bytes to read
+//                off - position in the file to read from
+// Outputs      : bytes read if successful, -1 if failure
 
-	////////////////////////////////////////////////////////////////
-	// 	  WE NOW HAVE ALL CONTENTS IN WRITEBUF TO MAKE SYSCALL    //
-	////////////////////////////////////////////////////////////////
+int32_t fs3_pread(int16_t fd, void *buf, int32_t count, uint32_t off) {
 
-	// Reset the values of curSec and reaminder
-	int sectorsPassed = 0;
+	// Variables for file tracking
+	int16_t fidx  = -1; // Index of the permanant file corresponding to the file handle
+	int16_t ofidx = -1; // Index of the open file corresponding to the file handle
 
-	// Find the next free trk/sec and write into that 
-	for(int trk = 0; trk<FS3_MAX_TRACKS; trk++){ 
+	// Find the open file
+	if(openedByHandle(fd, &ofidx, &fidx) == -1){
+		return(-1);
+	}
 
-		// Check to see if all data has been written
-		if(sectorsWrote == numToChange){ // Cacsaces from below loop
-			break;
-		}
+	// Same bounds as a seek to the offset
+	if((int64_t)off > oftable[ofidx].oflength){
+		logMessage(FS3DriverLLevel, "Offset %u past the end of fh %d in [PREAD], exiting program", off, fd);
+		return(-1);
+	}
 
-		// Check each sector
-		for(int sec = 0; sec<FS3_TRACK_SIZE; sec++){
+	// A positional read leaves the handle's readahead window alone
+	struct iovec one = { buf, count };
+	return(readvAt(ofidx, &one, 1, off, 0));
+}
 
-			// Check to see if all data has been written
-			if(sectorsWrote == numToChange){
-				break;
-			}
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_pwrite
+// Description  : Writes "count" bytes from the buffer "buf" at offset "off" of 
+//                the file handle "fh", leaving the file position alone
+//
+// Inputs       : fd - filename of the file to write to
+//                buf - pointer to buffer to write from
+//                count - number of bytes to write
+//                off - position in the file to write at
+// Outputs      : bytes written if successful, -1 if failure
 
-			// Want to start sec at firstSec and then write the next numToChange sectors
+int32_t fs3_pwrite(int16_t fd, void *buf, int32_t count, uint32_t off) {
 
-			// Check for sector owned by the file
-			if(oftable[ofidx].ofloc[trk][sec] == 1){
-				
-				// Get to the first sector to write into
-				if(sectorsPassed == firstSec){ 
+	// Variables for file tracking
+	int16_t fidx  = -1; // Index of the permanant file corresponding to the file handle
+	int16_t ofidx = -1; // Index of the open file corresponding to the file handle
 
-					// Check track
-					if(trk != curTrk){
-						// Switch Tracks
-						int8_t switchRet = switchTrack(trk);
+	// Find the open file
+	if(openedByHandle(fd, &ofidx, &fidx) == -1){
+		return(-1);
+	}
 
-						// Check for failure
-						if(switchRet == -1){
-							logMessage(FS3DriverLLevel, "switchTrack return value = %d", switchRet);
-							return(-1);
-						}
-					}
+	// Same bounds as a seek to the offset
+	if((int64_t)off > oftable[ofidx].oflength){
+		logMessage(FS3DriverLLevel, "Offset %u past the end of fh %d in [PWRITE], exiting program", off, fd);
+		return(-1);
+	}
 
-					// Copy one sector worth of data into a tmpBuf buffer
-					memcpy(tmpBuf, &writeBuf[writePos], FS3_SECTOR_SIZE);
+	struct iovec one = { buf, count };
+	return(writevAt(ofidx, fidx, &one, 1, off));
+}
 
-					// Check to see if the sector is in the cache and the cache data is the same as tmpBuf
-					cachePtr = fs3_get_cache(trk, sec); // Probably dont need this or the if statment(only the else)
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_readv
+// Description  : Reads from the file handle "fh" into the "iovcnt" buffers of 
+//                "iov", filling each in turn, in one pass over the sectors
+//
+// Inputs       : fd - filename of the file to read from
+//                iov - buffers to read into
+//                iovcnt - number of buffers
+// Outputs      : bytes read if successful, -1 if failure
 
-					// Check to see if it was found
-					if(cachePtr != NULL && memcmp(cachePtr, tmpBuf, FS3_SECTOR_SIZE) == 0){ 
-						// Local variable
-						FS3CmdBlk retCmd;
+int32_t fs3_readv(int16_t fd, const struct iovec *iov, int iovcnt) {
 
-						// Write the 'ith' sector worth of information
-						int netSuccess = network_fs3_syscall(construct_fs3_cmdblock(FS3_OP_WRSECT, sec, 0, 0), &retCmd, cachePtr);
+	// Variables for file tracking
+	int16_t fidx  = -1; // Index of the permanant file corresponding to the file handle
+	int16_t ofidx = -1; // Index of the open file corresponding to the file handle
+	int32_t count = -1; // Bytes read
 
-						// Deconstruct the command block to see if it worked properly (ret == 0) -> pass, (ret == 1) -> fail.
-						deconstruct_fs3_cmdblock(retCmd, &opval, &secval, &trkval, &retval);
+	// Find the open file
+	if(iovcnt < 0 || openedByHandle(fd, &ofidx, &fidx) == -1){
+		return(-1);
+	}
 
-						//Read failed, bail
-						if(retval != 0 || netSuccess == -1){
-							logMessage(FS3DriverLLevel,"System call to write to sector %d for fh %d failed, exiting program", sec, oftable[ofidx].ofhandle);
-							return(-1);
-						}
-					}else{
-						// Local variable
-						FS3CmdBlk retCmd;
+	// Read at the current position
+	count = readvAt(ofidx, iov, iovcnt, oftable[ofidx].ofpos, 1);
+	if(count == -1){
+		return(-1);
+	}
 
-						// Write the 'ith' sector worth of information
-						int netSuccess = network_fs3_syscall(construct_fs3_cmdblock(FS3_OP_WRSECT, sec, 0, 0), &retCmd, tmpBuf);
+	// Update the new position
+	oftable[ofidx].ofpos += count;
+	return(count);
+}
 
-						// Deconstruct the command block to see if it worked properly (ret == 0) -> pass, (ret == 1) -> fail.
-						deconstruct_fs3_cmdblock(retCmd, &opval, &secval, &trkval, &retval);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_writev
+// Description  : Writes the "iovcnt" buffers of "iov" to the file handle "fh", 
+//                one after another, in one pass over the sectors
+//
+// Inputs       : fd - filename of the file to write to
+//                iov - buffers to write from
+//                iovcnt - number of buffers
+// Outputs      : bytes written if successful, -1 if failure
 
-						//Read failed, bail
-						if(retval != 0 || netSuccess == -1){
-							logMessage(FS3DriverLLevel,"System call to write to sector %d for fh %d failed, exiting program", sec, oftable[ofidx].ofhandle);
-							return(-1);
-						}
+int32_t fs3_writev(int16_t fd, const struct iovec *iov, int iovcnt) {
 
-						// Place data in the cache (write through)
-						int putRet = fs3_put_cache(trk, sec, tmpBuf);
+	// Variables for file tracking
+	int16_t fidx  = -1; // Index of the permanant file corresponding to the file handle
+	int16_t ofidx = -1; // Index of the open file corresponding to the file handle
+	int32_t count = -1; // Bytes written
 
-						// Failure condition
-						if(putRet == -1){
-							logMessage(FS3DriverLLevel, "Failed to palce data in cache, exiting program");
-							return(-1);
-						}
-					}
+	// Find the open file
+	if(iovcnt < 0 || openedByHandle(fd, &ofidx, &fidx) == -1){
+		return(-1);
+	}
 
-					// Increment
-					sectorsWrote++;
-					writePos += FS3_SECTOR_SIZE;
-				}else{
-					// Increment
-					sectorsPassed++;
-				}
-			}
-		}
+	// Write at the current position
+	count = writevAt(ofidx, fidx, iov, iovcnt, oftable[ofidx].ofpos);
+	if(count == -1){
+		return(-1);
 	}
 
 	// Update the new position
 	oftable[ofidx].ofpos += count;
+	return(count);
+}
 
-	// Log info
-	logMessage(FS3DriverLLevel, "FS3 DRVR: write on fh %d (%d bytes) [pos=%d, len=%d]",
-		oftable[ofidx].ofhandle, count, oftable[ofidx].ofpos, oftable[ofidx].oflength);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_sync
+// Description  : Writes every sector of the file handle "fh" still dirty in the 
+//                cache out to the disk (write-back)
+//
+// Inputs       : fd - file handle of the file to sync
+// Outputs      : 0 if successful, -1 if failure
 
-	// Free Buffers 
-	free(writeBuf);
-	free(tmpBuf);
+int32_t fs3_sync(int16_t fd) {
 
-	// NULL Buffers
-	writeBuf = NULL; 
-	tmpBuf   = NULL;
-	cachePtr = NULL; // Never malloced, just need to reset value
-	
-	// Indicate success
-	return(count);
+	// Variables for file tracking
+	int16_t fidx  = -1; // Index of the permanant file corresponding to the file handle
+	int16_t ofidx = -1; // Index of the open file corresponding to the file handle
+
+	// Find the open file
+	if(openedByHandle(fd, &ofidx, &fidx) == -1){
+		return(-1);
+	}
+
+	// Flush the lines inside the file's extents
+	if(fs3_flush_cache(oftable[ofidx].ofext, oftable[ofidx].ofnumext) == -1){
+		logMessage(FS3DriverLLevel, "Failed to sync fh %d, exiting program", fd);
+		return(-1);
+	}
+
+	logMessage(FS3DriverLLevel, "File fh %d synced.", fd);
+	return(0);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
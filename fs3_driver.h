@@ -13,6 +13,7 @@
 
 // Include files
 #include <stdint.h>
+#include <sys/uio.h>
 
 // Project includes
 #include <fs3_controller.h>
@@ -20,17 +21,46 @@
 // Defines
 #define FS3_MAX_TOTAL_FILES 1024 // Maximum number of files ever
 #define FS3_MAX_PATH_LENGTH 128 // Maximum length of filename length
+#define FS3_DEFAULT_ALLOC_WINDOW 64 // Sectors reserved for a file at a time by the affinity policy
+#define FS3_DEFAULT_READAHEAD 32 // Largest readahead window of a sequential reader, in sectors
+#define FS3_READAHEAD_INIT 4 // Readahead window of a reader that just turned sequential, in sectors
+#define FS3_DEFAULT_FILL_GROUP 1 // Aligned sectors a read miss fills at once (1 is the missed sector only)
+#define FS3_DRIVER_BATCH 64 // Most sector reads the driver sends down the pipeline before waiting
+#define FS3_READ_SCRATCH 4 // Partial sectors a pipelined read batch can receive
 
 
 //Type Definitions / Internal Data Structures
 
+// Policies for placing new sectors on the disk
+typedef enum {
+	FS3_ALLOC_FIRSTFIT = 0, // First free run on the disk
+	FS3_ALLOC_AFFINITY = 1, // Reserve windows of sectors per file on the first-fit track
+} FS3AllocPolicy;
+
+// Run of contiguous sectors on a single track owned by a file
+typedef struct FS3Extent{
+	FS3TrackIndex etrk;  // Track the run is on
+	FS3SectorIndex esec; // First sector of the run
+	uint16_t elen;       // Number of sectors in the run
+} FS3Extent;
+
+// Location of a single sector on the disk
+typedef struct FS3SectorLoc{
+	FS3TrackIndex strk;  // Track the sector is on
+	FS3SectorIndex ssec; // Sector within the track
+} FS3SectorLoc;
+
 // Permanent file structure | Tracks the metadata
 typedef struct FS3File{
 	char fname[128]; // Files Permanent filename
 	int32_t flength; // Length of the file 
-	uint_fast32_t floc[FS3_MAX_TRACKS][FS3_TRACK_SIZE]; // What track the file is on 
+	FS3Extent *fext; // Track/sector runs the file is on (in file order)
+	int32_t fnumext; // Number of extents in fext
+	int32_t fextcap; // Number of extents fext has room for
 	char fstate[6]; // "opened" if open, "closed" if closed
 	int32_t numsec; // Nuber of sectors the file takes up
+	int16_t ftrk;    // Track the file last grew on, -1 if not grown yet (affinity)
+	FS3Extent fresv; // Sectors set aside for the file's next allocations (affinity)
 } FS3File;
  
 // Temporary data to track current state of the file | Only valid when a file is open
@@ -39,10 +69,23 @@ typedef struct FS3OpenFile{
 	int32_t oflength; // Length of the file 
 	int16_t ofhandle;// File Handle (Unique number) | Only valid while the file is open
 	uint32_t ofpos; // Current position of the file 
-	uint_fast32_t ofloc[FS3_MAX_TRACKS][FS3_TRACK_SIZE]; // What track the file is on 
+	FS3Extent *ofext; // Track/sector runs the file is on (in file order)
+	int32_t ofnumext; // Number of extents in ofext
+	int32_t ofextcap; // Number of extents ofext has room for
+	FS3SectorLoc *ofmap; // Location of every sector of the file, indexed by file sector
+	int32_t ofmapcap; // Number of sectors ofmap has room for
 	int32_t numsec; // Number of sectors the file takes up
+	int32_t ofranext; // File sector a sequential read would start in
+	int32_t ofrasize; // Sectors the next readahead window covers, 0 if not reading sequentially
+	int32_t ofraend;  // One past the last file sector read ahead
 } FS3OpenFile;
 
+// Handle table entry | Where an open file handle lives in both file tables
+typedef struct FS3Handle{
+	int16_t hofidx; // Index of the open file, -1 if the handle is not open
+	int16_t hfidx;  // Index of the permanent file, -1 if the handle is not open
+} FS3Handle;
+
 FS3OpenFile oftable[FS3_MAX_TOTAL_FILES];
 FS3File ftable[FS3_MAX_TOTAL_FILES];
 
@@ -51,11 +94,80 @@ FS3File ftable[FS3_MAX_TOTAL_FILES];
 int8_t switchTrack(int16_t trk);
 	// Switches the current track to "trk"
 
+int16_t currentTrack(void);
+	// Tells which track the controller is on
+
+int32_t trackSeeks(void);
+	// Tells how many track seeks have been sent to the controller
+
+int16_t nextFreeSec(int16_t trk, int16_t sec);
+	// Finds the first free sector at or after "sec" on a track in the free sector bitmap
+
+int16_t nextUsedSec(int16_t trk, int16_t sec);
+	// Finds the first used sector at or after "sec" on a track in the free sector bitmap
+
+void markSectors(int16_t trk, int16_t sec, int16_t len);
+	// Marks a run of sectors as used in the free sector bitmap
+
+void unmarkSectors(int16_t trk, int16_t sec, int16_t len);
+	// Marks a run of sectors on a track as free in the free sector bitmap
+
+void releaseReservation(int16_t fidx);
+	// Gives the unused sectors a file set aside (affinity) back to the free sector bitmap
+
 int8_t findFreeLoc(int16_t *trkidx, int16_t *secidx);
-	// Finds the indexs of the next free track and sector based on the globalLoc array
+	// Finds the indexs of the next free track and sector based on the free sector bitmap
+
+int16_t findRunOnTrack(int16_t trk, int16_t want, int16_t *secidx);
+	// Finds the first free run of "want" sectors on a track, or the longest one
+
+int16_t findFreeRun(int16_t want, int16_t *trkidx, int16_t *secidx);
+	// Allocates a run of up to "want" contiguous free sectors on one track
+
+int16_t frontierTrack(int16_t want, int16_t *secidx);
+	// Finds the first track with a free run of "want" sectors, taking back reservations it passes
+
+int16_t findAffinityRun(int16_t fidx, int32_t have, int16_t want, int16_t *trkidx, int16_t *secidx);
+	// Allocates up to "want" sectors for a file from its reservation on the first-fit track
+
+int16_t allocSectors(int16_t fidx, int32_t have, int16_t want, int16_t *trkidx, int16_t *secidx);
+	// Allocates up to "want" contiguous sectors for a file using the allocation policy
+
+int fs3_set_alloc_policy(FS3AllocPolicy policy, uint16_t window);
+	// Selects the allocation policy and its reservation window
+
+int fs3_set_readahead(uint16_t maxWindow);
+	// Sets the largest window sequential readers prefetch (0 turns readahead off)
+
+int fs3_set_fill_group(uint16_t sectors);
+	// Sets the aligned group of sectors a read miss fills (a power of two, up to a whole track)
+
+int fs3_log_driver_metrics(void);
+	// Log the controller operations issued by the driver
+
+int8_t appendExtent(FS3Extent **ext, int32_t *numext, int32_t *extcap, int16_t trk, int16_t sec);
+	// Adds the sector "trk"/"sec" to the end of an extent list, growing the list as needed
+
+int8_t buildSectorMap(int16_t ofidx);
+	// Expands the extent list of an open file into its sector map
+
+int8_t addFileSector(int16_t ofidx, int16_t trk, int16_t sec);
+	// Adds a newly allocated sector to the end of an open file's extents and sector map
 
 int16_t idxByHandle(int16_t fd, int16_t *ofidx, int16_t *fidx);
-	// Finds the indexs of both the open and permanant files based on a given file handle 
+	// Finds the indexs of both the open and permanant files based on a given file handle
+
+int16_t openedByHandle(int16_t fd, int16_t *ofidx, int16_t *fidx);
+	// Resolves a file handle once for an I/O call and checks that the file is open
+
+uint32_t hashFileName(const char *path);
+	// Hashes a filename into a bucket of the filename index
+
+int16_t findFileByName(const char *path);
+	// Finds the index of the permanent file named "path" using the filename index
+
+int8_t addFileName(int16_t fidx);
+	// Adds a permanent file to the filename index
 
 FS3CmdBlk construct_fs3_cmdblock(uint8_t op, uint16_t sec, uint_fast32_t trk, uint8_t ret);
 	// Creates a commandblock to do the requested operation at the correct location
@@ -75,13 +187,85 @@ int16_t fs3_open(char *path);
 int16_t fs3_close(int16_t fd);
 	// This function closes a file
 
+char * fetchSector(int16_t trk, int16_t sec, char *scratch, int8_t ready);
+	// Finds the contents of one sector through the cache without copying them
+
+int8_t readSector(int16_t trk, int16_t sec, char *buf);
+	// Reads one sector through the cache
+
+int8_t readSectorDisk(int16_t trk, int16_t sec, char *buf);
+	// Reads one sector from the controller, bypassing the cache
+
+int8_t prefetchSectors(int16_t trk, int16_t *secs, int32_t n);
+	// Reads uncached sectors of one track into the cache as one pipeline batch (or a few)
+
+int8_t fillGroup(int16_t ofidx, int32_t fsec);
+	// Reads the file's uncached sectors in a missed sector's aligned group into the cache
+
+int8_t writeSectorDisk(int16_t trk, int16_t sec, char *buf);
+	// Writes one sector to the controller, bypassing the cache
+
+int8_t queueSectorDisk(int16_t trk, int16_t sec, char *buf, uint8_t op);
+	// Sends a sector read or write down the pipeline without waiting for it
+
+int8_t waitSectorsDisk(void);
+	// Waits for every sector operation sent down the pipeline
+
+int8_t writeSector(int16_t trk, int16_t sec, char *buf);
+	// Writes one sector through the cache (write-through or write-back)
+
+char * iovSpan(const struct iovec *iov, int iovcnt, int32_t off, int32_t len);
+	// Finds bytes of an iovec byte stream that sit in a single segment
+
+void iovCopy(const struct iovec *iov, int iovcnt, int32_t off, char *data, int32_t len, int8_t toIov);
+	// Copies bytes between a flat buffer and an iovec byte stream
+
+int16_t elevatorNext(uint64_t pending);
+	// C-LOOK scheduler, the next pending track at or above the current one (wrapping around)
+
+void scheduleBatch(int32_t arrivalSeeks, int32_t issuedSeeks);
+	// Counts a batch that went to the disk and the seeks issued below arrival order
+
+uint64_t planTracks(int16_t ofidx, int32_t firstSec, int32_t lastSec, int8_t misses, int32_t *arrivalSeeks);
+	// Finds the tracks a request touches so the elevator visits each one once, and its arrival order seeks
+
+int8_t extendFile(int16_t ofidx, int16_t fidx, int32_t end);
+	// Allocates sectors so an open file covers the first "end" bytes
+
+int8_t prefetchTrack(int16_t ofidx, int16_t trk, int32_t firstSec, int32_t lastSec);
+	// Reads the file sectors in [firstSec, lastSec) on one track that are not cached into the cache
+
+void readAhead(int16_t ofidx, int32_t pos, int32_t count, int32_t *raFrom, int32_t *raTo);
+	// Detects sequential reads and picks the adaptive window of next sectors to read ahead
+
+int32_t readvAt(int16_t ofidx, const struct iovec *iov, int iovcnt, int32_t pos, int8_t sequential);
+	// Reads at "pos" of an open file into "iov", the file position is untouched (readahead only if sequential)
+
+int32_t writevAt(int16_t ofidx, int16_t fidx, const struct iovec *iov, int iovcnt, int32_t pos);
+	// Writes "iov" at "pos" of an open file, the file position is untouched
+
 int32_t fs3_read(int16_t fd, void *buf, int32_t count);
 	// Reads "count" bytes from the file handle "fh" into the buffer  "buf"
 
 int32_t fs3_write(int16_t fd, void *buf, int32_t count);
 	// Writes "count" bytes to the file handle "fh" from the buffer  "buf"
 
+int32_t fs3_sync(int16_t fd);
+	// Writes the sectors of a file still dirty in the cache to the disk
+
 int32_t fs3_seek(int16_t fd, uint32_t loc);
 	// Seek to specific point in the file
 
+int32_t fs3_pread(int16_t fd, void *buf, int32_t count, uint32_t off);
+	// Reads "count" bytes at offset "off" without moving the file position
+
+int32_t fs3_pwrite(int16_t fd, void *buf, int32_t count, uint32_t off);
+	// Writes "count" bytes at offset "off" without moving the file position
+
+int32_t fs3_readv(int16_t fd, const struct iovec *iov, int iovcnt);
+	// Reads from the file handle "fh" into the buffers of "iov"
+
+int32_t fs3_writev(int16_t fd, const struct iovec *iov, int iovcnt);
+	// Writes the buffers of "iov" to the file handle "fh"
+
 #endif
\ No newline at end of file
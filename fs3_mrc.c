@@ -0,0 +1,444 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : fs3_mrc.c
+//  Description    : This is the implementation of the miss ratio curve estimator
+//                   of the FS3 sector cache. Sectors are sampled by a hash of
+//                   their address (SHARDS), the LRU stack distance of every use
+//                   of a sampled sector is found with a Fenwick tree over last
+//                   use timestamps and scaled up by the sampling rate into a
+//                   histogram, which gives the hit ratio of every cache size.
+//
+//  Author         : Patrick McDaniel | Matthew Sites
+//  Last Modified  : Sun 19 Nov 2021 09:36:52 AM EDT
+//
+
+// Includes
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Project Includes
+#include <fs3_mrc.h>
+#include <fs3_controller.h>
+#include <cmpsc311_log.h>
+
+//
+// Support Macros/Data
+#define MRC_HASH_BUCKETS (2 * FS3_MRC_MAX_SAMPLES) // Buckets of the sampled sector index (power of two)
+
+//
+// Global Variables
+FS3MrcEntry *mrcEntries = NULL;               // Sampled sectors being tracked
+int32_t *mrcHash = NULL;                      // Index of the sampled sectors, first entry of each chain or -1
+int32_t *mrcTree = NULL;                      // Fenwick tree, 1 at each timestamp that is some sector's last use
+int32_t *mrcStampKey = NULL;                  // Entry whose last use is at each timestamp, -1 if none
+int64_t *mrcHist = NULL;                      // Scaled uses by stack distance bucket
+int64_t mrcCold = 0;                          // Scaled uses of sectors not seen before
+int64_t mrcTotal = 0;                         // Scaled uses in all
+int64_t mrcSampled = 0;                       // Sampled uses (unscaled)
+int32_t mrcFree = -1;                         // First unused entry
+int32_t mrcTracked = 0;                       // Entries in use
+int32_t mrcClock = 0;                         // Next timestamp
+uint32_t mrcThreshold = FS3_MRC_HASH_RANGE;   // Sample a sector when its hash is below this
+
+//
+// Implementation
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_mrc_hash
+// Description  : Spatial sampling hash of a sector, the same sector always gets
+//                the same value so every use of a sampled sector is seen
+//
+// Inputs       : key - track * FS3_TRACK_SIZE + sector
+// Outputs      : hash in [0, FS3_MRC_HASH_RANGE)
+
+uint32_t fs3_mrc_hash(int32_t key){
+
+    // Different multiplier from the cache index so the two do not line up
+    uint32_t h = ((uint32_t)key + 1) * 0x85EBCA77u;
+    h ^= h >> 15;
+    h *= 0xC2B2AE3Du;
+    h ^= h >> 13;
+    return(h % FS3_MRC_HASH_RANGE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_mrc_init
+// Description  : Allocate the estimator with every sector sampled to start with
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int fs3_mrc_init(void){
+
+    // Already done
+    if(mrcEntries != NULL){
+        return(0);
+    }
+
+    mrcEntries  = malloc(sizeof(FS3MrcEntry) * FS3_MRC_MAX_SAMPLES);
+    mrcHash     = malloc(sizeof(int32_t) * MRC_HASH_BUCKETS);
+    mrcTree     = calloc(FS3_MRC_CLOCK_SIZE + 1, sizeof(int32_t));
+    mrcStampKey = malloc(sizeof(int32_t) * FS3_MRC_CLOCK_SIZE);
+    mrcHist     = calloc(FS3_MRC_BUCKETS, sizeof(int64_t));
+
+    // Check for success
+    if(mrcEntries == NULL || mrcHash == NULL || mrcTree == NULL || mrcStampKey == NULL || mrcHist == NULL){
+        logMessage(LOG_INFO_LEVEL, "Allocating the miss ratio curve estimator failed.");
+        fs3_mrc_close();
+        return(-1);
+    }
+
+    // Every entry free, nothing sampled yet
+    for(int32_t i = 0; i < FS3_MRC_MAX_SAMPLES; i++){
+        (mrcEntries + i) -> mnext = (i + 1 < FS3_MRC_MAX_SAMPLES) ? i + 1 : -1;
+    }
+    memset(mrcHash, 0xff, sizeof(int32_t) * MRC_HASH_BUCKETS);
+    memset(mrcStampKey, 0xff, sizeof(int32_t) * FS3_MRC_CLOCK_SIZE);
+    mrcFree      = 0;
+    mrcTracked   = 0;
+    mrcClock     = 0;
+    mrcThreshold = FS3_MRC_HASH_RANGE;
+    mrcCold = mrcTotal = mrcSampled = 0;
+
+    return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_mrc_close
+// Description  : Free the estimator, the curve starts over at the next use
+//
+// Inputs       : none
+// Outputs      : none
+
+void fs3_mrc_close(void){
+    free(mrcEntries);
+    free(mrcHash);
+    free(mrcTree);
+    free(mrcStampKey);
+    free(mrcHist);
+    mrcEntries  = NULL;
+    mrcHash     = NULL;
+    mrcTree     = NULL;
+    mrcStampKey = NULL;
+    mrcHist     = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_mrc_fenwick_add
+// Description  : Adds "delta" at a timestamp of the Fenwick tree
+//
+// Inputs       : stamp - the timestamp
+//                delta - 1 when it becomes a last use, -1 when it stops being one
+// Outputs      : none
+
+void fs3_mrc_fenwick_add(int32_t stamp, int32_t delta){
+    for(int32_t i = stamp + 1; i <= FS3_MRC_CLOCK_SIZE; i += i & -i){
+        mrcTree[i] += delta;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_mrc_fenwick_sum
+// Description  : Counts the sampled sectors whose last use is at or before a
+//                timestamp
+//
+// Inputs       : stamp - the timestamp
+// Outputs      : number of sectors
+
+int32_t fs3_mrc_fenwick_sum(int32_t stamp){
+
+    // Local variables
+    int32_t sum = 0;
+
+    for(int32_t i = stamp + 1; i > 0; i -= i & -i){
+        sum += mrcTree[i];
+    }
+
+    return(sum);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_mrc_find
+// Description  : Looks a sampled sector up in the index
+//
+// Inputs       : key - track * FS3_TRACK_SIZE + sector
+// Outputs      : entry index if tracked, -1 if not
+
+int32_t fs3_mrc_find(int32_t key){
+
+    // Walk the chain of the bucket
+    for(int32_t e = mrcHash[((uint32_t)key * 2654435761u >> 8) & (MRC_HASH_BUCKETS - 1)]; e != -1; e = (mrcEntries + e) -> mnext){
+        if((mrcEntries + e) -> key == key){
+            return(e);
+        }
+    }
+
+    return(-1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_mrc_drop
+// Description  : Stops tracking a sampled sector, its last use no longer counts
+//                towards any stack distance
+//
+// Inputs       : entry - the entry to drop
+// Outputs      : none
+
+void fs3_mrc_drop(int32_t entry){
+
+    // Local variables
+    FS3MrcEntry *ent = mrcEntries + entry;
+
+    // Skip over it in the hash chain
+    int32_t *link = &mrcHash[((uint32_t)ent -> key * 2654435761u >> 8) & (MRC_HASH_BUCKETS - 1)];
+    while(*link != entry){
+        link = &(mrcEntries + *link) -> mnext;
+    }
+    *link = ent -> mnext;
+
+    // Its timestamp is free again
+    fs3_mrc_fenwick_add(ent -> stamp, -1);
+    mrcStampKey[ent -> stamp] = -1;
+
+    // Back on the free list
+    ent -> mnext = mrcFree;
+    mrcFree = entry;
+    mrcTracked--;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_mrc_lower_threshold
+// Description  : Halves the sampling rate once too many sectors are tracked,
+//                dropping the ones whose hash is no longer below the threshold
+//                (fixed size SHARDS)
+//
+// Inputs       : none
+// Outputs      : none
+
+void fs3_mrc_lower_threshold(void){
+
+    mrcThreshold /= 2;
+
+    for(int32_t s = 0; s < mrcClock; s++){
+        int32_t e = mrcStampKey[s];
+        if(e != -1 && fs3_mrc_hash((mrcEntries + e) -> key) >= mrcThreshold){
+            fs3_mrc_drop(e);
+        }
+    }
+
+    logMessage(LOG_INFO_LEVEL, "Miss ratio curve sampling rate now 1/%d.", FS3_MRC_HASH_RANGE / mrcThreshold);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_mrc_renumber
+// Description  : Gives the tracked sectors the timestamps 0..n-1 in the order of
+//                their last uses, once the clock reaches the end of the tree
+//
+// Inputs       : none
+// Outputs      : none
+
+void fs3_mrc_renumber(void){
+
+    // Local variables
+    int32_t next = 0;
+
+    // Timestamps are already in order, pack them to the front
+    memset(mrcTree, 0, sizeof(int32_t) * (FS3_MRC_CLOCK_SIZE + 1));
+    for(int32_t s = 0; s < mrcClock; s++){
+        int32_t e = mrcStampKey[s];
+        mrcStampKey[s] = -1;
+        if(e != -1){
+            (mrcEntries + e) -> stamp = next;
+            mrcStampKey[next] = e;
+            fs3_mrc_fenwick_add(next, 1);
+            next++;
+        }
+    }
+
+    mrcClock = next;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_mrc_access
+// Description  : Records a use of a sector. Only sampled sectors are looked at,
+//                their stack distance (distinct sampled sectors used since their
+//                last use) divided by the sampling rate is a distance in cache
+//                lines. Writes move the sector up the stack but only reads go
+//                into the curve, like the cache hit ratio.
+//
+// Inputs       : trk - the track number of the sector
+//                sct - the sector number of the sector
+//                read - 1 for a read, 0 for a write
+// Outputs      : none
+
+void fs3_mrc_access(FS3TrackIndex trk, FS3SectorIndex sct, int8_t read){
+
+    // Local variables
+    int32_t key = trk * FS3_TRACK_SIZE + sct;
+    int64_t scale;
+    int32_t e;
+
+    // Not sampled (cheap test first, everything else only for sampled sectors)
+    if(fs3_mrc_hash(key) >= mrcThreshold || fs3_mrc_init() == -1){
+        return;
+    }
+
+    // Room for the next timestamp
+    if(mrcClock == FS3_MRC_CLOCK_SIZE){
+        fs3_mrc_renumber();
+    }
+
+    // A new sector needs an entry, keep the number of tracked sectors bounded
+    e = fs3_mrc_find(key);
+    while(e == -1 && mrcFree == -1){
+        fs3_mrc_lower_threshold();
+        if(fs3_mrc_hash(key) >= mrcThreshold){
+            return;
+        }
+    }
+
+    // Each sampled read stands for 1/rate reads
+    scale = FS3_MRC_HASH_RANGE / mrcThreshold;
+    if(read){
+        mrcSampled++;
+        mrcTotal += scale;
+    }
+
+    if(e != -1){
+        // Distinct sectors used since, scaled to the whole address space
+        int32_t since = mrcTracked - fs3_mrc_fenwick_sum((mrcEntries + e) -> stamp);
+        int64_t dist  = (int64_t)since * scale;
+        if(read && dist < FS3_MRC_MAX_LINES){
+            mrcHist[dist / FS3_MRC_BUCKET] += scale;
+        }
+
+        // Move its last use up to now
+        fs3_mrc_fenwick_add((mrcEntries + e) -> stamp, -1);
+        mrcStampKey[(mrcEntries + e) -> stamp] = -1;
+    }else{
+        // First use, a miss at any cache size
+        if(read){
+            mrcCold += scale;
+        }
+        e = mrcFree;
+        mrcFree = (mrcEntries + e) -> mnext;
+        (mrcEntries + e) -> key = key;
+        uint32_t bucket = ((uint32_t)key * 2654435761u >> 8) & (MRC_HASH_BUCKETS - 1);
+        (mrcEntries + e) -> mnext = mrcHash[bucket];
+        mrcHash[bucket] = e;
+        mrcTracked++;
+    }
+
+    (mrcEntries + e) -> stamp = mrcClock;
+    mrcStampKey[mrcClock] = e;
+    fs3_mrc_fenwick_add(mrcClock, 1);
+    mrcClock++;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_mrc_hit_ratio
+// Description  : Estimates the hit ratio of an LRU cache of a number of lines,
+//                the share of uses with a stack distance below its size
+//
+// Inputs       : lines - cache size in lines
+// Outputs      : hit ratio in percent
+
+double fs3_mrc_hit_ratio(int32_t lines){
+
+    // Local variables
+    int64_t hits = 0;
+
+    if(mrcHist == NULL || mrcTotal == 0){
+        return(0.0);
+    }
+
+    for(int32_t b = 0; b < FS3_MRC_BUCKETS && (b + 1) * FS3_MRC_BUCKET <= lines; b++){
+        hits += mrcHist[b];
+    }
+
+    return(100.0 * (double)hits / (double)mrcTotal);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_mrc_best_size
+// Description  : Finds the smallest cache whose estimated hit ratio is within
+//                "withinPct" points of the best one up to maxLines
+//
+// Inputs       : withinPct - hit ratio points the cache may give up
+//                maxLines - largest cache size to consider
+// Outputs      : cache size in lines, -1 if there are too few samples yet
+
+int32_t fs3_mrc_best_size(double withinPct, int32_t maxLines){
+
+    // Local variables
+    double best;
+
+    // Not enough to go on
+    if(mrcSampled < 1000){
+        return(-1);
+    }
+
+    best = fs3_mrc_hit_ratio(maxLines);
+    for(int32_t lines = FS3_MRC_BUCKET; lines < maxLines; lines += FS3_MRC_BUCKET){
+        if(fs3_mrc_hit_ratio(lines) >= best - withinPct){
+            return(lines);
+        }
+    }
+
+    return(maxLines);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_mrc_samples
+// Description  : Tells how many sampled reads the curve is built from
+//
+// Inputs       : none
+// Outputs      : number of sampled reads
+
+int64_t fs3_mrc_samples(void){
+    return(mrcSampled);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_mrc_log_curve
+// Description  : Log the estimated hit ratio at doubling cache sizes, up to the
+//                size where it stops changing
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int fs3_mrc_log_curve(void){
+
+    // Nothing recorded
+    if(mrcTotal == 0){
+        return(0);
+    }
+
+    logMessage(LOG_OUTPUT_LEVEL, "Cache MRC       [%ld sampled reads, rate 1/%d]", (long)mrcSampled, FS3_MRC_HASH_RANGE / mrcThreshold);
+
+    double top = fs3_mrc_hit_ratio(FS3_MRC_MAX_LINES);
+    for(int32_t lines = FS3_MRC_BUCKET; lines <= FS3_MRC_MAX_LINES; lines *= 2){
+        double ratio = fs3_mrc_hit_ratio(lines);
+        logMessage(LOG_OUTPUT_LEVEL, "  %6d lines   [%.2f%%]", lines, ratio);
+        if(ratio >= top){
+            break;
+        }
+    }
+
+    return(0);
+}
@@ -0,0 +1,77 @@
+#ifndef FS3_MRC_INCLUDED
+#define FS3_MRC_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : fs3_mrc.h
+//  Description    : This is the interface for the miss ratio curve estimator of
+//                   the FS3 sector cache (sampled LRU stack distances, SHARDS).
+//
+//  Author         : Patrick McDaniel | Matthew Sites
+//  Last Modified  : Sun 19 Nov 2021 09:36:52 AM EDT
+//
+
+// Include
+#include <stdint.h>
+#include <fs3_controller.h>
+
+// Defines
+#define FS3_MRC_HASH_RANGE 4096     // Sampling hash range, a sector is sampled if its hash is below the threshold
+#define FS3_MRC_MAX_SAMPLES 8192    // Most sampled sectors tracked at once, the threshold drops to stay below
+#define FS3_MRC_CLOCK_SIZE (4 * FS3_MRC_MAX_SAMPLES) // Timestamps before the sampled sectors are renumbered
+#define FS3_MRC_BUCKET 16           // Cache lines per bucket of the stack distance histogram
+#define FS3_MRC_MAX_LINES 65536     // Largest cache size the curve covers
+#define FS3_MRC_BUCKETS (FS3_MRC_MAX_LINES / FS3_MRC_BUCKET)
+
+// Sampled sector, last time it was used
+typedef struct FS3MrcEntry{
+    int32_t key;        // Track * FS3_TRACK_SIZE + sector
+    int32_t stamp;      // Timestamp of the last use
+    int32_t mnext;      // Next entry in the same hash bucket (next free entry when unused)
+}FS3MrcEntry;
+
+//
+// Miss Ratio Curve Functions
+uint32_t fs3_mrc_hash(int32_t key);
+    // Spatial sampling hash of a sector, in [0, FS3_MRC_HASH_RANGE)
+
+int fs3_mrc_init(void);
+    // Allocate the estimator (done on first use)
+
+void fs3_mrc_close(void);
+    // Free the estimator and forget the curve
+
+void fs3_mrc_fenwick_add(int32_t stamp, int32_t delta);
+    // Mark or unmark a timestamp as the last use of a sampled sector
+
+int32_t fs3_mrc_fenwick_sum(int32_t stamp);
+    // Count the sampled sectors last used at or before a timestamp
+
+int32_t fs3_mrc_find(int32_t key);
+    // Find the entry of a sampled sector (-1 if not tracked)
+
+void fs3_mrc_drop(int32_t entry);
+    // Stop tracking a sampled sector
+
+void fs3_mrc_lower_threshold(void);
+    // Halve the sampling rate, dropping the sectors no longer sampled
+
+void fs3_mrc_renumber(void);
+    // Renumber the timestamps of the sampled sectors once the clock runs out
+
+void fs3_mrc_access(FS3TrackIndex trk, FS3SectorIndex sct, int8_t read);
+    // Record a use of a sector (only reads count towards the curve)
+
+double fs3_mrc_hit_ratio(int32_t lines);
+    // Estimated LRU hit ratio (percent) of a cache of a number of lines
+
+int32_t fs3_mrc_best_size(double withinPct, int32_t maxLines);
+    // Smallest cache within "withinPct" points of the best hit ratio up to maxLines (-1 if too few samples)
+
+int64_t fs3_mrc_samples(void);
+    // Number of sampled reads the curve is built from
+
+int fs3_mrc_log_curve(void);
+    // Log the estimated hit ratio at doubling cache sizes
+
+#endif
@@ -14,6 +14,9 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <cmpsc311_log.h>
 
 // Project Includes
@@ -28,328 +31,378 @@
 //
 //  Global data
 
-// Defines
-#define ALL_BYTES_SIZE 1032
-
 unsigned char     *fs3_network_address = NULL; // Address of FS3 server
-unsigned short     fs3_network_port = 22887;          // Port of FS3 server
+unsigned short     fs3_network_port = FS3_DEFAULT_PORT; // Port of FS3 server
+char              *fs3_network_path = NULL;    // Unix domain socket of FS3 server (NULL to use TCP)
 
 // Variables for deconstructing the commandblock
 uint8_t opval, retval; // Updated 'op' value | Updated 'return' value -> (0 == Passed, 1 == Failed)
 uint16_t secval;       // Updated 'sector' value
 uint_fast32_t trkval;  // Updated track value
 
-// Buffers
-char *allBytes, *bufBytes;
-
 // Network variables
 int socket_fh;         // Stores socket file handle
-FS3CmdBlk orderedCmd;  // Used to convert data to and from network byte order 
-int64_t returnValue;
 
 // File structure for handleing internet addresses (IPv4)
 struct sockaddr_in clientAddr; // Extern from <netinet/in.h>
+struct sockaddr_un localAddr;  // Address of a server on the same host (Unix domain socket)
+int8_t netTcp = 0;             // 1 if the connection is TCP, 0 if it is a Unix domain socket
+
+// Pipeline of commands sent and waiting for their replies (replies come back in order)
+FS3NetPending netPending[FS3_NET_MAX_WINDOW]; // Ring of the commands in flight
+int32_t netHead   = 0;                        // Oldest command in flight
+int32_t netCount  = 0;                        // Commands in flight
+uint16_t netWindow = FS3_NET_WINDOW;          // Most commands in flight at once
+int8_t netFailed  = 0;                        // A reply since the last wait reported a failure
+FS3CmdBlk netLast = 0;                        // Last reply received, in host byte order
 
 //
 // Network functions
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : network_fs3_syscall
-// Description  : Perform a system call over the network
+// Function     : network_fs3_transfer
+// Description  : Sends or receives every byte the segments of "iov" describe,
+//                looping over partial transfers (the segments are consumed)
 //
-// Inputs       : cmd - the command block to send
-//                ret - the returned command block
-//                buf - the buffer to place received data in (Always FS3_SECTOR_SIZE)
+// Inputs       : iov - segments to send from or receive into
+//                iovcnt - number of segments
+//                send - 1 to send, 0 to receive
 // Outputs      : 0 if successful, -1 if failure
 
-int network_fs3_syscall(FS3CmdBlk cmd, FS3CmdBlk *ret, void *buf){
-
-    // Local variables 
-    char *ip = "127.0.0.1";      // Default loopback address
-    unsigned short port = 22887; // Server port
-
-    // Deconstruct to find what syscall is being made
-	deconstruct_fs3_cmdblock(cmd, &opval, &secval, &trkval, &retval); 
-    
-    ////////////////////////////////////////////////////////////////
-    // 			 GET ADDRESS/PORT && SETUP STRUCTURE              //
-    ////////////////////////////////////////////////////////////////
+int network_fs3_transfer(struct iovec *iov, int iovcnt, int8_t send){
 
-    if(opval == FS3_OP_MOUNT){
-        logMessage(LOG_NETWORK_LEVEL, "Setting up ip and port");
+    // Local variables
+    ssize_t moved;
 
-        // Clear garbage data
-        memset(&clientAddr, 0, sizeof(clientAddr));
+    while(iovcnt > 0){
 
-        clientAddr.sin_family = AF_INET;      // Set family (what types of addresses the socket can communicate with)
-        clientAddr.sin_port   = htons(port);  // Convert port from host byte order to server byte order
-
-        // Convert string dot address to network address and sets it to clientAddr.sin_addr.s_addr
-        if( inet_aton(ip, &(clientAddr.sin_addr)) == 0){ // Check for failure
-            logMessage(LOG_NETWORK_LEVEL, "Failed to convert IPv4 address to sin_addr, exiting program");
-            return(-1);
+        // Acknowledge what comes in right away, or the server holds its next reply back
+        // (Nagle) until a delayed acknowledgement goes out, as the client sends nothing
+        // for one to ride on while it waits. The kernel clears the flag again, so set it
+        // before each receive.
+#ifdef TCP_QUICKACK
+        if(!send && netTcp){
+            int quick = 1;
+            setsockopt(socket_fh, IPPROTO_TCP, TCP_QUICKACK, &quick, sizeof(quick));
         }
+#endif
 
-        // Allocate memory (deallocated during UNMOUNT)
-        allBytes = (char *)malloc(FS3_SECTOR_SIZE + 8);  // Create an area for cmd + buffer bytes (8 bytes + 1024 bytes = 1032 bytes);
-        bufBytes = (char *)malloc(FS3_SECTOR_SIZE);      // Big enough for a sector of data
-    
-        ////////////////////////////////////////////////////////////////
-        // 			             CREATE THE SOCKET                    //
-        ////////////////////////////////////////////////////////////////
-
-        logMessage(LOG_NETWORK_LEVEL, "Creating a socket");
-
-        // Create the socket (PF_INET: Protocol family; SOCK_STREAM: client/server communication continues until a party terminates)
-        socket_fh = socket(PF_INET, SOCK_STREAM, 0);
-        
-        // Check for failure
-        if(socket_fh == -1){
-            logMessage(LOG_NETWORK_LEVEL, "Failed to create a socket, exiting the program.");
+        moved = send ? writev(socket_fh, iov, iovcnt) : readv(socket_fh, iov, iovcnt);
+        if(moved == -1 && errno == EINTR){
+            continue;
+        }
+        if(moved <= 0){
+            logMessage(LOG_NETWORK_LEVEL, "%s failed, exiting program [%s]", send ? "Write to server" : "Read from server",
+                (moved == 0) ? "connection closed" : strerror(errno));
             return(-1);
-        }  
-
-        logMessage(LOG_NETWORK_LEVEL, "socket_fh: %d", socket_fh);
-    
-        ////////////////////////////////////////////////////////////////
-        // 			   CONNECT THE SOCKET TO THE SERVER               //
-        ////////////////////////////////////////////////////////////////
-    
-        // tmp is returning -1 for some reason
-        int tmp = connect(socket_fh, (const struct sockaddr *)&clientAddr, sizeof(clientAddr));
+        }
 
-        // Connect the socket to the server
-        if( tmp == -1 ){
-            logMessage(LOG_NETWORK_LEVEL, "Failed to connect the socket to the server, exiting the program");
-            logMessage(LOG_NETWORK_LEVEL, "Error: [%s]", strerror(errno));
-            return(-1);
+        // Step past the segments that were finished, and into the one that was not
+        while(iovcnt > 0 && (size_t)moved >= iov -> iov_len){
+            moved -= iov -> iov_len;
+            iov++;
+            iovcnt--;
         }
-        
-        ////////////////////////////////////////////////////////////////
-        // 			                CALL TO MOUNT                     //
-        ////////////////////////////////////////////////////////////////
+        if(iovcnt > 0){
+            iov -> iov_base = (char *)iov -> iov_base + moved;
+            iov -> iov_len -= moved;
+        }
+    }
 
-        logMessage(LOG_NETWORK_LEVEL, "[MOUNT] op code recieved");
+    return(0);
+}
 
-        // Order cmdblk bytes in network order
-        orderedCmd = htonll64(cmd);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : network_fs3_set_window
+// Description  : Sets how many commands the pipeline keeps in flight on the
+//                socket (1 waits for each reply before sending the next)
+//
+// Inputs       : window - commands in flight at once
+// Outputs      : 0 if successful, -1 if failure
 
-        // Send the data in buf to the server for a write
-        returnValue = write(socket_fh, &orderedCmd, sizeof(orderedCmd));
+int network_fs3_set_window(uint16_t window){
 
-        // Check for failure
-        if(returnValue != sizeof(orderedCmd)){
-            logMessage(LOG_NETWORK_LEVEL, "Failed to mount filesystem over network, exiting program");
-            return(-1);
-        }
+    // Failure condition
+    if(window < 1 || window > FS3_NET_MAX_WINDOW){
+        logMessage(LOG_ERROR_LEVEL, "Pipeline window must be 1 to %d commands.", FS3_NET_MAX_WINDOW);
+        return(-1);
+    }
+    if(netCount > 0){
+        logMessage(LOG_ERROR_LEVEL, "Cannot change the pipeline window with commands in flight.");
+        return(-1);
+    }
 
-        ////////////////////////////////////////////////////////////////
-        // 			       READ BACK RETURNED CMDBLK                  //
-        ////////////////////////////////////////////////////////////////
+    netWindow = window;
+    return(0);
+}
 
-        // Read back from the server
-        returnValue = read(socket_fh, &orderedCmd, sizeof(orderedCmd));
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : network_fs3_window
+// Description  : Tells how many commands the pipeline keeps in flight
+//
+// Inputs       : none
+// Outputs      : the pipeline window
 
-        // Order the returned commandblock in host order
-        orderedCmd = ntohll64(orderedCmd);
+uint16_t network_fs3_window(void){
+    return(netWindow);
+}
 
-        // Do I want to do error checking on the returned commandblock here or in driver.c?
-        deconstruct_fs3_cmdblock(orderedCmd, &opval, &secval, &trkval, &retval);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : network_fs3_complete
+// Description  : Receives the reply to the oldest command in flight, with the
+//                sector it carries for a read
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if the connection failed
 
-        // Check for failure
-        if(returnValue != sizeof(orderedCmd)){
-            logMessage(LOG_NETWORK_LEVEL, "Short-read of %d bytes from %d requested bytes, exiting program",
-                returnValue, sizeof(orderedCmd));
-            return(-1);
-        }else if(retval != 0){ 
-            logMessage(LOG_NETWORK_LEVEL, "Read from server failed, exiting program");
-            return(-1);
-        } 
+int network_fs3_complete(void){
 
-        // Send commandblock to output
-        *ret = orderedCmd;
+    // Local variables
+    FS3NetPending *pend = &netPending[netHead];
+    FS3CmdBlk reply;
+    struct iovec iov[2];
 
+    // Nothing in flight
+    if(netCount == 0){
         return(0);
     }
-    
-    ////////////////////////////////////////////////////////////////
-    // 			                CALL TO TSEEK                     //
-    ////////////////////////////////////////////////////////////////
+    netHead = (netHead + 1) % FS3_NET_MAX_WINDOW;
+    netCount--;
+
+    // The commandblock, then for a read the sector, received straight into its buffer
+    deconstruct_fs3_cmdblock(pend -> pcmd, &opval, &secval, &trkval, &retval);
+    iov[0].iov_base = &reply;
+    iov[0].iov_len  = sizeof(reply);
+    iov[1].iov_base = pend -> pbuf;
+    iov[1].iov_len  = FS3_SECTOR_SIZE;
+    if(network_fs3_transfer(iov, (opval == FS3_OP_RDSECT) ? 2 : 1, 0) == -1){
+        return(-1);
+    }
+    netLast = ntohll64(reply);
 
-    if(opval == FS3_OP_TSEEK){     
-        logMessage(LOG_NETWORK_LEVEL, "[SEEK] op code recieved");
+    // A failed command fails the batch it was in, the replies after it still have to be read
+    deconstruct_fs3_cmdblock(netLast, &opval, &secval, &trkval, &retval);
+    if(retval != 0){
+        logMessage(LOG_NETWORK_LEVEL, "Command on track %d, sector %d failed on the server", (int)trkval, secval);
+        netFailed = 1;
+    }
 
-        ////////////////////////////////////////////////////////////////
-        // 			            SEND COMMAND BLOCK                    //
-        ////////////////////////////////////////////////////////////////
+    return(0);
+}
 
-        // Order in network byte order
-        orderedCmd = htonll64(cmd);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : network_fs3_submit
+// Description  : Sends a command without waiting for its reply. Once the window
+//                is full the oldest reply is received first to make room.
+//
+// Inputs       : cmd - the command block to send
+//                buf - the sector to write, or to receive a read into (it must
+//                      stay valid until network_fs3_wait returns)
+// Outputs      : 0 if successful, -1 if failure
 
-        // Send cmdblk to server
-        returnValue = write(socket_fh, &orderedCmd, sizeof(orderedCmd));
+int network_fs3_submit(FS3CmdBlk cmd, void *buf){
 
-        // Check for failure
-        if(returnValue != sizeof(orderedCmd)){
-            logMessage(LOG_NETWORK_LEVEL, "Short-write of %d bytes from %d requested bytes, exiting program",
-                returnValue, sizeof(orderedCmd));
+    // Local variables
+    FS3CmdBlk ordered = htonll64(cmd);
+    struct iovec iov[2];
+
+    // Make room in the window
+    while(netCount >= netWindow){
+        if(network_fs3_complete() == -1){
             return(-1);
         }
+    }
 
-        ////////////////////////////////////////////////////////////////
-        // 			       READ BACK RETURNED CMDBLK                  //
-        ////////////////////////////////////////////////////////////////
+    // The commandblock in network order, then for a write the sector, straight from its buffer
+    deconstruct_fs3_cmdblock(cmd, &opval, &secval, &trkval, &retval);
+    iov[0].iov_base = &ordered;
+    iov[0].iov_len  = sizeof(ordered);
+    iov[1].iov_base = buf;
+    iov[1].iov_len  = FS3_SECTOR_SIZE;
+    if(network_fs3_transfer(iov, (opval == FS3_OP_WRSECT) ? 2 : 1, 1) == -1){
+        return(-1);
+    }
 
-        // Read cmdblk back from server
-        returnValue = read(socket_fh, &orderedCmd, sizeof(orderedCmd));
+    // Its reply comes back after the ones already in flight
+    FS3NetPending *pend = &netPending[(netHead + netCount) % FS3_NET_MAX_WINDOW];
+    pend -> pcmd = cmd;
+    pend -> pbuf = buf;
+    netCount++;
+
+    return(0);
+}
 
-        // Conver to host byte order
-        orderedCmd = ntohll64(orderedCmd);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : network_fs3_wait
+// Description  : Receives the replies to every command in flight
+//
+// Inputs       : ret - set to the last reply (may be NULL)
+// Outputs      : 0 if every command since the last wait succeeded, -1 if not
 
-        // Send to output
-        *ret = orderedCmd;
+int network_fs3_wait(FS3CmdBlk *ret){
 
-        // error check retCmd
-        deconstruct_fs3_cmdblock(orderedCmd, &opval, &secval, &trkval, &retval);
+    // Local variables
+    int8_t failed;
 
-        // Check for failure
-        if(returnValue != sizeof(orderedCmd)){
-            logMessage(LOG_NETWORK_LEVEL, "Short-read of %d bytes from %d requested bytes, exiting program",
-                returnValue, sizeof(orderedCmd));
+    while(netCount > 0){
+        if(network_fs3_complete() == -1){
             return(-1);
-        }else if(retval != 0){
-            logMessage(LOG_NETWORK_LEVEL, "Read from server failed, exiting program");
-            return(-1);
-        } 
-
-        return(0);
+        }
+    }
+    if(ret != NULL){
+        *ret = netLast;
     }
 
-    ////////////////////////////////////////////////////////////////
-    // 			                CALL TO WRITE                     //
-    ////////////////////////////////////////////////////////////////
+    // Report (and forget) the failures of the batch
+    failed = netFailed;
+    netFailed = 0;
+    return(failed ? -1 : 0);
+}
 
-    if(opval == FS3_OP_WRSECT){
-        logMessage(LOG_NETWORK_LEVEL, "[WRITE] op code recieved");
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : network_fs3_connect
+// Description  : Connects to the server, over a Unix domain socket if a path is
+//                set (a server on the same host, no TCP/IP stack in between) and
+//                over TCP to the address and port set (loopback by default) if not
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
 
-        // Clear memory
-        memset(allBytes, 0x0, ALL_BYTES_SIZE);
-        orderedCmd = 0;
+int network_fs3_connect(void){
 
-        ////////////////////////////////////////////////////////////////
-        // 			    SEND COMMAND BLOCK + BUF TO SERVER            //
-        ////////////////////////////////////////////////////////////////
+    // Local variables
+    const char *ip = (fs3_network_address != NULL) ? (const char *)fs3_network_address : FS3_DEFAULT_IP;
+    struct sockaddr *addr;
+    socklen_t addrlen;
 
-        // Order cmdblk bytes in network order
-        orderedCmd = htonll64(cmd);
+    ////////////////////////////////////////////////////////////////
+    // 			 GET ADDRESS/PORT && SETUP STRUCTURE              //
+    ////////////////////////////////////////////////////////////////
 
-        // Memcpy orderdBytes into allBytes
-        memcpy(&allBytes[0], &orderedCmd, 8);
+    netTcp = (fs3_network_path == NULL);
+    if(netTcp){
+        logMessage(LOG_NETWORK_LEVEL, "Setting up ip and port [%s:%d]", ip, fs3_network_port);
 
-        // Memccpy buffer over into allBytes
-        memcpy(&allBytes[8], buf, FS3_SECTOR_SIZE); 
+        // Clear garbage data
+        memset(&clientAddr, 0, sizeof(clientAddr));
 
-        // Send the cmdblk to the server 
-        returnValue = write(socket_fh, allBytes, ALL_BYTES_SIZE);
+        clientAddr.sin_family = AF_INET;                  // Set family (what types of addresses the socket can communicate with)
+        clientAddr.sin_port   = htons(fs3_network_port);  // Convert port from host byte order to server byte order
 
-        // Check for failure
-        if(returnValue != ALL_BYTES_SIZE){
-            logMessage(LOG_NETWORK_LEVEL, "Short-write of %d bytes from %d requested bytes, exiting program",
-                returnValue, ALL_BYTES_SIZE);
+        // Convert string dot address to network address and sets it to clientAddr.sin_addr.s_addr
+        if( inet_aton(ip, &(clientAddr.sin_addr)) == 0){ // Check for failure
+            logMessage(LOG_NETWORK_LEVEL, "Failed to convert IPv4 address [%s] to sin_addr, exiting program", ip);
+            return(-1);
+        }
+        addr    = (struct sockaddr *)&clientAddr;
+        addrlen = sizeof(clientAddr);
+    }else{
+        logMessage(LOG_NETWORK_LEVEL, "Setting up socket path [%s]", fs3_network_path);
+
+        // The path has to fit in the address, terminator included
+        if(strlen(fs3_network_path) >= sizeof(localAddr.sun_path)){
+            logMessage(LOG_NETWORK_LEVEL, "Socket path [%s] is too long, exiting program", fs3_network_path);
             return(-1);
         }
+        memset(&localAddr, 0, sizeof(localAddr));
+        localAddr.sun_family = AF_UNIX;
+        strcpy(localAddr.sun_path, fs3_network_path);
+        addr    = (struct sockaddr *)&localAddr;
+        addrlen = sizeof(localAddr);
+    }
 
-        ////////////////////////////////////////////////////////////////
-        // 			       READ BACK RETURNED CMDBLK                  //
-        ////////////////////////////////////////////////////////////////
+    ////////////////////////////////////////////////////////////////
+    // 			             CREATE THE SOCKET                    //
+    ////////////////////////////////////////////////////////////////
 
-        // Read back from the server
-        returnValue = read(socket_fh, &orderedCmd, sizeof(orderedCmd));
+    logMessage(LOG_NETWORK_LEVEL, "Creating a socket");
 
-        // Order the returned commandblock in host order
-        orderedCmd = ntohll64(orderedCmd);
+    // Create the socket (SOCK_STREAM: client/server communication continues until a party terminates)
+    socket_fh = socket(netTcp ? PF_INET : PF_UNIX, SOCK_STREAM, 0);
 
-        // Send commandblock output
-        *ret = orderedCmd;
+    // Check for failure
+    if(socket_fh == -1){
+        logMessage(LOG_NETWORK_LEVEL, "Failed to create a socket, exiting the program.");
+        return(-1);
+    }
 
-        // Do I want to do error checking on the returned commandblock here or in driver.c?
-        deconstruct_fs3_cmdblock(orderedCmd, &opval, &secval, &trkval, &retval);
+    logMessage(LOG_NETWORK_LEVEL, "socket_fh: %d", socket_fh);
 
-        // Check for failure
-        if(returnValue != sizeof(orderedCmd)){
-            logMessage(LOG_NETWORK_LEVEL, "Short-read of %d bytes from %d requested bytes, exiting program",
-                returnValue, sizeof(orderedCmd));
-            return(-1);
-        }else if(retval != 0){
-            logMessage(LOG_NETWORK_LEVEL, "Read from server in [WRITE] failed, exiting program");
-            return(-1);
-        } 
-
-        return(0);
+    // Send each command as soon as it is written, Nagle would hold a command back until
+    // the reply to the one before it acknowledged it, undoing the pipeline
+    int nodelay = 1;
+    if(netTcp && setsockopt(socket_fh, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) == -1){
+        logMessage(LOG_NETWORK_LEVEL, "Failed to turn off Nagle on the socket [%s]", strerror(errno));
     }
 
     ////////////////////////////////////////////////////////////////
-    // 			                 CALL TO READ                     //
+    // 			   CONNECT THE SOCKET TO THE SERVER               //
     ////////////////////////////////////////////////////////////////
 
-    if(opval == FS3_OP_RDSECT){
-        logMessage(LOG_NETWORK_LEVEL, "[READ] opcode recieved");
+    if(connect(socket_fh, addr, addrlen) == -1){
+        logMessage(LOG_NETWORK_LEVEL, "Failed to connect the socket to the server, exiting the program");
+        logMessage(LOG_NETWORK_LEVEL, "Error: [%s]", strerror(errno));
+        close(socket_fh);
+        socket_fh = -1;
+        return(-1);
+    }
 
-        // Clear memory
-        memset(allBytes, 0x0, ALL_BYTES_SIZE);
-        memset(bufBytes, 0x0, FS3_SECTOR_SIZE);
-        orderedCmd = 0;
+    return(0);
+}
 
-        ////////////////////////////////////////////////////////////////
-        // 			      SEND COMMAND BLOCK TO SERVER                //
-        ////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : network_fs3_syscall
+// Description  : Perform a system call over the network
+//
+// Inputs       : cmd - the command block to send
+//                ret - the returned command block
+//                buf - the buffer to place received data in (Always FS3_SECTOR_SIZE)
+// Outputs      : 0 if successful, -1 if failure
 
-        // Order cmdblk bytes in network order
-        orderedCmd = htonll64(cmd);
+int network_fs3_syscall(FS3CmdBlk cmd, FS3CmdBlk *ret, void *buf){
 
-        // Send the data in buf to the server for a write
-        returnValue = write(socket_fh, &orderedCmd, sizeof(orderedCmd));
+    // Deconstruct to find what syscall is being made
+	deconstruct_fs3_cmdblock(cmd, &opval, &secval, &trkval, &retval); 
 
-        // Check for failure
-        if(returnValue != sizeof(orderedCmd)){
-            logMessage(LOG_NETWORK_LEVEL, "Short-read of %d bytes from %d requested bytes, exiting program",
-                returnValue, sizeof(orderedCmd));
+    if(opval == FS3_OP_MOUNT){
+
+        // Reach the server (TCP or Unix domain socket)
+        if(network_fs3_connect() == -1){
             return(-1);
         }
 
         ////////////////////////////////////////////////////////////////
-        // 			         READ BACK RETURNED DATA                  //
+        // 			                CALL TO MOUNT                     //
         ////////////////////////////////////////////////////////////////
 
-        // Make call to read sector
-        returnValue = read(socket_fh, allBytes, ALL_BYTES_SIZE);
-
-        // Copy over returned commandblock
-        memcpy(&orderedCmd, &allBytes[0], 8);
-
-        // Parse buffer out
-        memcpy(buf, &allBytes[8], FS3_SECTOR_SIZE); // Cut the middle man
-
-        // Order the returned commandblock in host order
-        orderedCmd = ntohll64(orderedCmd);
+        logMessage(LOG_NETWORK_LEVEL, "[MOUNT] op code recieved");
 
-        // Send to output
-        *ret = orderedCmd;
+        // Mount the disk, a batch of one
+        if(network_fs3_submit(cmd, NULL) == -1 || network_fs3_wait(ret) == -1){
+            logMessage(LOG_NETWORK_LEVEL, "Failed to mount filesystem over network, exiting program");
+            return(-1);
+        }
 
-        // Do I want to do error checking on the returned commandblock here or in driver.c?
-        deconstruct_fs3_cmdblock(orderedCmd, &opval, &secval, &trkval, &retval);
+        return(0);
+    }
+    
+    ////////////////////////////////////////////////////////////////
+    // 			     CALL TO TSEEK / WRITE / READ                 //
+    ////////////////////////////////////////////////////////////////
 
-        // Check for failure
-        if(returnValue != ALL_BYTES_SIZE){
-            logMessage(LOG_NETWORK_LEVEL, "Short-read of %d bytes from %d requested bytes, exiting program",
-                returnValue, sizeof(orderedCmd));
-            return(-1);
-        }else if(retval != 0){
-            logMessage(LOG_NETWORK_LEVEL, "Read from server in [READ] failed, exiting program");
+    // A command on its own is a pipeline batch of one
+    if(opval == FS3_OP_TSEEK || opval == FS3_OP_WRSECT || opval == FS3_OP_RDSECT){
+        if(network_fs3_submit(cmd, buf) == -1 || network_fs3_wait(ret) == -1){
             return(-1);
         }
-
         return(0);
     }
 
@@ -360,52 +413,16 @@ int network_fs3_syscall(FS3CmdBlk cmd, FS3CmdBlk *ret, void *buf){
     if(opval == FS3_OP_UMOUNT){
         logMessage(LOG_NETWORK_LEVEL, "[UNMOUNT] opcode recieved");
 
-        ////////////////////////////////////////////////////////////////
-        // 			      SEND COMMAND BLOCK TO SERVER                //
-        ////////////////////////////////////////////////////////////////
-
-        // Order cmdblk bytes in network order
-        orderedCmd = htonll64(cmd);
-
-        // Send the data in buf to the server for a write
-        returnValue = write(socket_fh, &orderedCmd, sizeof(orderedCmd));
-
-        // Check for failure
-        if(returnValue != sizeof(orderedCmd)){
-            logMessage(LOG_NETWORK_LEVEL, "Short-read of %d bytes from %d requested bytes, exiting program",
-                returnValue, sizeof(orderedCmd));
+        // Collect the replies still in flight first
+        if(network_fs3_wait(NULL) == -1){
             return(-1);
         }
 
-        ////////////////////////////////////////////////////////////////
-        // 			       READ BACK RETURNED CMDBLK                  //
-        ////////////////////////////////////////////////////////////////
-
-        // Read back from the server
-        returnValue = read(socket_fh, &orderedCmd, sizeof(orderedCmd));
-
-        // Order the returned commandblock in host order
-        orderedCmd = ntohll64(orderedCmd);
-
-        // Send commandblock output
-        ret = &orderedCmd;
-
-        // Do I want to do error checking on the returned commandblock here or in driver.c?
-        deconstruct_fs3_cmdblock(orderedCmd, &opval, &secval, &trkval, &retval);
-
-        // Check for failure
-        if(returnValue != sizeof(orderedCmd)){
-            logMessage(LOG_NETWORK_LEVEL, "Short-read of %d bytes from %d requested bytes, exiting program",
-                returnValue, sizeof(orderedCmd));
-            return(-1);
-        }else if(retval != 0){
-            logMessage(LOG_NETWORK_LEVEL, "Read from server failed, exiting program");
+        // Unmount the disk, a batch of one
+        if(network_fs3_submit(cmd, NULL) == -1 || network_fs3_wait(ret) == -1){
+            logMessage(LOG_NETWORK_LEVEL, "Failed to unmount filesystem over network, exiting program");
             return(-1);
         }
-    
-        // Free buffers
-        free(allBytes);
-        free(bufBytes);
 
         // Close socket
         close(socket_fh);
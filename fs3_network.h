@@ -20,10 +20,19 @@
 #define FS3_NET_HEADER_SIZE sizeof(FS3CmdBlk)
 #define FS3_DEFAULT_IP "127.0.0.1" // Address to connect to
 #define FS3_DEFAULT_PORT 22887     // Port to connect to 
+#define FS3_NET_WINDOW 16          // Commands the pipeline keeps in flight, by default
+#define FS3_NET_MAX_WINDOW 256     // Most commands the pipeline can keep in flight
+
+// Command sent down the pipeline and waiting for its reply
+typedef struct FS3NetPending{
+	FS3CmdBlk pcmd;     // The command, in host byte order
+	void *pbuf;         // Sector a read is received into (NULL if none)
+}FS3NetPending;
 
 // Global data
 extern unsigned char *fs3_network_address;     // Address of FS3 server
 extern unsigned short fs3_network_port;        // Port of FS3 server
+extern char *fs3_network_path;                 // Unix domain socket of FS3 server (NULL to use TCP)
 
 //
 // Functional Prototypes
@@ -31,4 +40,22 @@ extern unsigned short fs3_network_port;        // Port of FS3 server
 int network_fs3_syscall(FS3CmdBlk cmd, FS3CmdBlk *ret, void *buf);
 	// This is the client/network system call for communicating with controller
 
+int network_fs3_connect(void);
+	// Connect to the server (Unix domain socket if a path is set, TCP if not)
+
+int network_fs3_set_window(uint16_t window);
+	// Set how many commands the pipeline keeps in flight (1 for one at a time)
+
+uint16_t network_fs3_window(void);
+	// Tell how many commands the pipeline keeps in flight
+
+int network_fs3_complete(void);
+	// Receive the reply to the oldest command in flight
+
+int network_fs3_submit(FS3CmdBlk cmd, void *buf);
+	// Send a TSEEK, RDSECT or WRSECT without waiting for its reply
+
+int network_fs3_wait(FS3CmdBlk *ret);
+	// Receive every reply in flight (-1 if the connection or any command failed)
+
 #endif
@@ -14,6 +14,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <ctype.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -26,23 +27,39 @@
 #include <fs3_common.h>
 #include <fs3_cache.h>
 #include <fs3_network.h>
+#include <fs3_trace.h>
 #include <cmpsc311_log.h>
 #include <cmpsc311_util.h>
 
 // Defines
 #define FS3_WORKLOAD_DIR "workload"
 #define FS3_SIM_MAX_OPEN_FILES 256
-#define FS3_ARGUMENTS "hvc:l:i:p:"
+#define FS3_ARGUMENTS "hvbUc:m:l:i:p:u:a:r:H:e:w:R:F:T:t:g:P:"
 #define USAGE \
-	"USAGE: fs3_sim [-h] [-v] [-c <cache size>] [-l <logfile>] <workload-file>\n" \
+	"USAGE: fs3_sim [-h] [-v] [-b] [-U] [-c <cache size>] [-m <cache bytes>] [-l <logfile>] [-i <ip>] [-p <port>] [-u <socket>] [-a <policy>] [-r <window>] [-H <pages>] [-e <policy>] [-w <ways>] [-R <sectors>] [-g <sectors>] [-P <commands>] [-F <filter>] [-T <percent>] [-t <tracefile>] <workload-file>\n" \
 	"\n" \
 	"where:\n" \
 	"    -h - help mode (display this message)\n" \
 	"    -v - verbose output\n" \
+	"    -b - write-back cache (writes reach the disk when flushed)\n" \
+	"    -U - run the unit tests instead of a workload\n" \
 	"    -c - set the cache size (in number of sectors)\n" \
+	"    -m - set the cache size as a memory budget in bytes (K or M suffix allowed)\n" \
 	"    -l - write log messages to the filename <logfile>\n" \
     "    -i - IP address of server to connect to.\n" \
     "    -p - port number of server to connect to.\n" \
+    "    -u - Unix domain socket of a server on the same host (instead of -i/-p).\n" \
+    "    -a - sector allocation policy (firstfit or affinity)\n" \
+    "    -r - sectors reserved for a file at a time by the affinity policy\n" \
+    "    -H - pages backing the cache data (normal, thp or hugetlb)\n" \
+    "    -e - cache replacement policy (lru, clock, 2q, arc or s3fifo)\n" \
+    "    -w - set-associative cache with <ways> lines per set (pseudo-LRU)\n" \
+    "    -R - largest readahead window in sectors (0 turns readahead off)\n" \
+    "    -g - sectors a read miss fills at once, an aligned group (power of two, 1024 for a whole track)\n" \
+    "    -P - commands kept in flight to the server at once (1 waits for each reply)\n" \
+    "    -F - cache admission filter (all, second or tinylfu)\n" \
+    "    -T - auto size the cache, giving up at most <percent> hit ratio points (never above the -c/-m size)\n" \
+    "    -t - record every sector access to <tracefile> (replay it with fs3_tracesim)\n" \
 	"\n" \
 	"    <workload-file> - file contain the workload to simulate\n" \
 	"\n" \
@@ -57,6 +74,19 @@ typedef struct {
 // Global Data
 int verbose;
 uint16_t fs3CacheSize = FS3_DEFAULT_CACHE_SIZE; 
+unsigned long fs3CacheBytes = 0;
+FS3AllocPolicy fs3AllocMode = FS3_ALLOC_FIRSTFIT;
+uint16_t fs3AllocReserve = FS3_DEFAULT_ALLOC_WINDOW;
+uint8_t fs3WriteBack = 0;
+FS3CachePages fs3CachePages = FS3_CACHE_PAGES_NORMAL;
+FS3CachePolicy fs3CachePolicy = FS3_CACHE_LRU;
+uint8_t fs3CacheWays = 0;
+uint16_t fs3ReadAhead = FS3_DEFAULT_READAHEAD;
+uint16_t fs3GroupFill = FS3_DEFAULT_FILL_GROUP;
+uint16_t fs3NetWindow = FS3_NET_WINDOW;
+FS3CacheAdmit fs3CacheAdmit = FS3_ADMIT_ALL;
+double fs3AutoTunePct = -1.0;
+char *fs3TracePath = NULL;
 
 //
 // Functional Prototypes
@@ -79,7 +109,7 @@ int validate_file(char *fname, int16_t mfh);  // Validate a file in the filesyst
 int main( int argc, char *argv[] ) {
 
 	// Local variables
-	int ch, verbose = 0, log_initialized = 0;
+	int ch, verbose = 0, log_initialized = 0, unit_tests = 0;
 
 	// Process the command line parameters
 	while ((ch = getopt(argc, argv, FS3_ARGUMENTS)) != -1) {
@@ -93,6 +123,14 @@ int main( int argc, char *argv[] ) {
 			verbose = 1;
 			break;
 
+		case 'b': // Write-back cache
+			fs3WriteBack = 1;
+			break;
+
+		case 'U': // Unit tests
+			unit_tests = 1;
+			break;
+
 		case 'l': // Set the log filename
 			initializeLogWithFilename( optarg );
 			log_initialized = 1;
@@ -105,6 +143,17 @@ int main( int argc, char *argv[] ) {
 			}
 			break;
 
+		case 'm': // Set the cache memory budget
+			{
+				char unit = ' ';
+				if ( sscanf(optarg, "%lu%c", &fs3CacheBytes, &unit) < 1) {
+					logMessage(LOG_ERROR_LEVEL, "Failed parsing cache bytes [%s]", optarg);
+					return(-1);
+				}
+				fs3CacheBytes *= (toupper(unit) == 'M') ? 1024*1024 : (toupper(unit) == 'K') ? 1024 : 1;
+			}
+			break;
+
 		case 'i': // Get the IP address
 			if (inet_addr(optarg) == INADDR_NONE) {
 				logMessage( LOG_ERROR_LEVEL, "Bad IP address [%s]", argv[optind] );
@@ -120,6 +169,110 @@ int main( int argc, char *argv[] ) {
 			}
 			break;
 
+		case 'u': // Reach the server through a Unix domain socket
+			fs3_network_path = strdup(optarg);
+			break;
+
+		case 'a': // Set the allocation policy
+			if (strcmp(optarg, "firstfit") == 0) {
+				fs3AllocMode = FS3_ALLOC_FIRSTFIT;
+			} else if (strcmp(optarg, "affinity") == 0) {
+				fs3AllocMode = FS3_ALLOC_AFFINITY;
+			} else {
+				logMessage(LOG_ERROR_LEVEL, "Unknown allocation policy [%s]", optarg);
+				return(-1);
+			}
+			break;
+
+		case 'r': // Set the reservation window
+			if ( sscanf(optarg, "%hu", &fs3AllocReserve) != 1) {
+				logMessage(LOG_ERROR_LEVEL, "Failed parsing reservation window [%s]", optarg);
+				return(-1);
+			}
+			break;
+
+		case 'H': // Set the pages backing the cache data
+			if (strcmp(optarg, "normal") == 0) {
+				fs3CachePages = FS3_CACHE_PAGES_NORMAL;
+			} else if (strcmp(optarg, "thp") == 0) {
+				fs3CachePages = FS3_CACHE_PAGES_THP;
+			} else if (strcmp(optarg, "hugetlb") == 0) {
+				fs3CachePages = FS3_CACHE_PAGES_HUGETLB;
+			} else {
+				logMessage(LOG_ERROR_LEVEL, "Unknown cache page type [%s]", optarg);
+				return(-1);
+			}
+			break;
+
+		case 'e': // Set the cache replacement policy
+			if (strcmp(optarg, "lru") == 0) {
+				fs3CachePolicy = FS3_CACHE_LRU;
+			} else if (strcmp(optarg, "clock") == 0) {
+				fs3CachePolicy = FS3_CACHE_CLOCK;
+			} else if (strcmp(optarg, "2q") == 0) {
+				fs3CachePolicy = FS3_CACHE_2Q;
+			} else if (strcmp(optarg, "arc") == 0) {
+				fs3CachePolicy = FS3_CACHE_ARC;
+			} else if (strcmp(optarg, "s3fifo") == 0) {
+				fs3CachePolicy = FS3_CACHE_S3FIFO;
+			} else {
+				logMessage(LOG_ERROR_LEVEL, "Unknown cache replacement policy [%s]", optarg);
+				return(-1);
+			}
+			break;
+
+		case 'w': // Set the ways of a set-associative cache
+			if ( sscanf(optarg, "%hhu", &fs3CacheWays) != 1) {
+				logMessage(LOG_ERROR_LEVEL, "Failed parsing cache ways [%s]", optarg);
+				return(-1);
+			}
+			break;
+
+		case 'R': // Set the readahead window
+			if ( sscanf(optarg, "%hu", &fs3ReadAhead) != 1) {
+				logMessage(LOG_ERROR_LEVEL, "Failed parsing readahead window [%s]", optarg);
+				return(-1);
+			}
+			break;
+
+		case 'g': // Set the group a read miss fills
+			if ( sscanf(optarg, "%hu", &fs3GroupFill) != 1) {
+				logMessage(LOG_ERROR_LEVEL, "Failed parsing fill group [%s]", optarg);
+				return(-1);
+			}
+			break;
+
+		case 'P': // Set the pipeline window
+			if ( sscanf(optarg, "%hu", &fs3NetWindow) != 1) {
+				logMessage(LOG_ERROR_LEVEL, "Failed parsing pipeline window [%s]", optarg);
+				return(-1);
+			}
+			break;
+
+		case 'F': // Set the cache admission filter
+			if (strcmp(optarg, "all") == 0) {
+				fs3CacheAdmit = FS3_ADMIT_ALL;
+			} else if (strcmp(optarg, "second") == 0) {
+				fs3CacheAdmit = FS3_ADMIT_SECOND;
+			} else if (strcmp(optarg, "tinylfu") == 0) {
+				fs3CacheAdmit = FS3_ADMIT_TINYLFU;
+			} else {
+				logMessage(LOG_ERROR_LEVEL, "Unknown cache admission filter [%s]", optarg);
+				return(-1);
+			}
+			break;
+
+		case 't': // Record a sector access trace
+			fs3TracePath = optarg;
+			break;
+
+		case 'T': // Auto size the cache from its miss ratio curve
+			if ( (sscanf(optarg, "%lf", &fs3AutoTunePct) != 1) || (fs3AutoTunePct < 0.0) ) {
+				logMessage(LOG_ERROR_LEVEL, "Failed parsing auto sizing percent [%s]", optarg);
+				return(-1);
+			}
+			break;
+
 		default:  // Default (unknown)
 			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
 			return( -1 );
@@ -137,6 +290,11 @@ int main( int argc, char *argv[] ) {
 		enableLogLevels(FS3ControllerLLevel | FS3DriverLLevel | FS3SimulatorLLevel);
 	}
 
+	// Run the unit tests, no workload or server needed
+	if ( unit_tests ) {
+		return( fs3_cache_unit_test() );
+	}
+
 	// The filename should be the next option
 	if ( optind >= argc ) {
 		fprintf( stderr, "Missing command line parameters, use -h to see usage, aborting.\n" );
@@ -184,7 +342,16 @@ int simulate_FS3( char *wload ) {
 	}
 
 	// Startup the interface
-	if ( (fs3_mount_disk() == -1) || (fs3_init_cache(fs3CacheSize) == -1) ){
+	if ( ((fs3TracePath != NULL) && (fs3_trace_open(fs3TracePath) == -1)) ||
+		 (fs3_set_alloc_policy(fs3AllocMode, fs3AllocReserve) == -1) || (fs3_set_readahead(fs3ReadAhead) == -1) ||
+		 (fs3_set_fill_group(fs3GroupFill) == -1) || (network_fs3_set_window(fs3NetWindow) == -1) ||
+		 (fs3_mount_disk() == -1) || (fs3_set_cache_pages(fs3CachePages) == -1) ||
+		 (fs3_set_cache_policy(fs3CachePolicy) == -1) || (fs3_set_cache_ways(fs3CacheWays) == -1) ||
+		 (fs3_set_cache_admission(fs3CacheAdmit) == -1) ||
+		 ((fs3CacheBytes ? fs3_init_cache_bytes(fs3CacheBytes) : fs3_init_cache(fs3CacheSize)) == -1) ||
+		 (fs3_set_cache_writeback(fs3WriteBack, FS3_DEFAULT_DIRTY_LOW, FS3_DEFAULT_DIRTY_HIGH) == -1) ||
+		 (fs3_set_cache_autotune(fs3AutoTunePct >= 0.0, fs3AutoTunePct,
+			fs3CacheBytes ? fs3_cache_lines_for_bytes(fs3CacheBytes) : fs3CacheSize) == -1) ){
 		logMessage( LOG_ERROR_LEVEL, "FS3 simulator failed initialization.");
 		fclose( fhandle );
 		return( -1 );
@@ -258,13 +425,6 @@ int simulate_FS3( char *wload ) {
 				// Log the command executed
 				logMessage(FS3SimulatorLLevel, "FS3_SIM : Writing %d bytes at position %d from file [%s]", len, off, fname);
 
-				// First perform the seek
-				if (fs3_seek(ftable[idx].fhandle, off)) {
-					// Failed, error out
-					logMessage(LOG_ERROR_LEVEL, "Seek/WriteAt file [%s] to position %d failed, aborting simulation.", fname, off);
-					return(-1);
-				}
-
 				// Now see if we need more data to fill, terminate the lines
 				CMPSC311_ASSERT1(len<1024, "Simulated workload command text too large [%d]", len);
 				CMPSC311_ASSERT2((strlen(sep+1)>=len), "Workload str [%d<%d]", strlen(sep+1), len);
@@ -276,10 +436,10 @@ int simulate_FS3( char *wload ) {
 					}
 				}
 
-				// Now perform the write
-				if (fs3_write(ftable[idx].fhandle, text, len) != len) {
+				// Now perform the positional write
+				if (fs3_pwrite(ftable[idx].fhandle, text, len, off) != len) {
 					// Failed, error out
-					logMessage(LOG_ERROR_LEVEL, "WriteAt of file [%s], length %d failed, aborting simulation.", fname, len);
+					logMessage(LOG_ERROR_LEVEL, "WriteAt of file [%s], length %d at position %d failed, aborting simulation.", fname, len, off);
 					return(-1);
 				}
 
@@ -373,7 +533,11 @@ int simulate_FS3( char *wload ) {
 		logMessage(LOG_ERROR_LEVEL, "FS3 simulation failed, controller metrics failed");
 		return(-1);
 	}
-	if ((fs3_unmount_disk() == -1) || (fs3_close_cache() == -1)) {
+	if ( fs3_log_driver_metrics() == -1 ) {
+		logMessage(LOG_ERROR_LEVEL, "FS3 simulation failed, driver metrics failed");
+		return(-1);
+	}
+	if ((fs3_unmount_disk() == -1) || (fs3_close_cache() == -1) || (fs3_trace_close() == -1)) {
 		logMessage( LOG_ERROR_LEVEL, "FS3 simulator failed shutdown.");
 		fclose( fhandle );
 		return( -1 );
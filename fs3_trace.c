@@ -0,0 +1,221 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : fs3_trace.c
+//  Description    : This is the implementation of the sector access traces of
+//                   the FS3 driver. Every sector the driver reads or writes
+//                   through the cache is appended to a binary trace file as a
+//                   fixed size record, buffered so tracing costs little more
+//                   than a copy per access.
+//
+//  Author         : Patrick McDaniel | Matthew Sites
+//  Last Modified  : Sun 19 Nov 2021 09:36:52 AM EDT
+//
+
+// Includes
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Project Includes
+#include <fs3_trace.h>
+#include <cmpsc311_log.h>
+
+//
+// Global Variables
+FILE *traceFile = NULL;                           // Trace being written, NULL if tracing is off
+FS3TraceRecord traceBuf[FS3_TRACE_BUFFER];        // Records not written out yet
+int32_t traceCount = 0;                           // Records in traceBuf
+int64_t traceRecords = 0;                         // Records in the trace in all
+struct timespec traceLast;                        // Time of the previous record
+
+//
+// Implementation
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_trace_open
+// Description  : Creates a trace file and starts recording sector accesses to it
+//
+// Inputs       : path - the file to write the trace to
+// Outputs      : 0 if successful, -1 if failure
+
+int fs3_trace_open(const char *path){
+
+    // Local variables
+    FS3TraceHeader hdr;
+
+    // Failure condition
+    if(traceFile != NULL){
+        logMessage(LOG_INFO_LEVEL, "A trace is already being written.");
+        return(-1);
+    }
+
+    traceFile = fopen(path, "wb");
+    if(traceFile == NULL){
+        logMessage(LOG_INFO_LEVEL, "Opening the trace file [%s] failed.", path);
+        return(-1);
+    }
+
+    // Header first, the records follow
+    memcpy(hdr.magic, FS3_TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.version = FS3_TRACE_VERSION;
+    hdr.recsize = sizeof(FS3TraceRecord);
+    if(fwrite(&hdr, sizeof(hdr), 1, traceFile) != 1){
+        logMessage(LOG_INFO_LEVEL, "Writing the trace header failed.");
+        fclose(traceFile);
+        traceFile = NULL;
+        return(-1);
+    }
+
+    traceCount   = 0;
+    traceRecords = 0;
+    clock_gettime(CLOCK_MONOTONIC, &traceLast);
+    return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_trace_record
+// Description  : Adds a sector access to the trace, stamped with the time since
+//                the previous one
+//
+// Inputs       : op - read or write
+//                trk - the track number of the sector
+//                sct - the sector number of the sector
+//                file - handle of the file the sector belongs to
+//                bytes - bytes of the sector the request covered
+// Outputs      : none
+
+void fs3_trace_record(FS3TraceOp op, FS3TrackIndex trk, FS3SectorIndex sct, int16_t file, int32_t bytes){
+
+    // Local variables
+    struct timespec now;
+    int64_t usec;
+
+    // Tracing is off
+    if(traceFile == NULL){
+        return;
+    }
+
+    // Microseconds since the last record, saturated
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    usec = (int64_t)(now.tv_sec - traceLast.tv_sec) * 1000000 + (now.tv_nsec - traceLast.tv_nsec) / 1000;
+    traceLast = now;
+
+    FS3TraceRecord *rec = &traceBuf[traceCount++];
+    rec -> tdelta = (usec > UINT32_MAX) ? UINT32_MAX : (uint32_t)usec;
+    rec -> tsec   = sct;
+    rec -> tbytes = bytes;
+    rec -> tfile  = file;
+    rec -> ttrk   = trk;
+    rec -> top    = op;
+    traceRecords++;
+
+    // Write out a full buffer (a failure stops the tracing, not the driver)
+    if(traceCount == FS3_TRACE_BUFFER && fs3_trace_flush() == -1){
+        fclose(traceFile);
+        traceFile = NULL;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_trace_flush
+// Description  : Writes the buffered records to the trace file
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int fs3_trace_flush(void){
+
+    if(traceFile == NULL || traceCount == 0){
+        return(0);
+    }
+
+    if(fwrite(traceBuf, sizeof(FS3TraceRecord), traceCount, traceFile) != (size_t)traceCount){
+        logMessage(LOG_INFO_LEVEL, "Writing the trace failed, tracing stopped.");
+        traceCount = 0;
+        return(-1);
+    }
+    traceCount = 0;
+
+    return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_trace_close
+// Description  : Writes out what is left and closes the trace file
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int fs3_trace_close(void){
+
+    // Local variables
+    int ret;
+
+    if(traceFile == NULL){
+        return(0);
+    }
+
+    ret = fs3_trace_flush();
+    if(fclose(traceFile) != 0){
+        ret = -1;
+    }
+    traceFile = NULL;
+
+    logMessage(LOG_INFO_LEVEL, "Trace closed [%ld sector accesses].", (long)traceRecords);
+    return(ret);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fs3_trace_load
+// Description  : Reads a whole trace file into memory, checking its header
+//
+// Inputs       : path - the trace file
+//                records - set to the records read (free them when done)
+// Outputs      : number of records if successful, -1 if failure
+
+int64_t fs3_trace_load(const char *path, FS3TraceRecord **records){
+
+    // Local variables
+    FS3TraceHeader hdr;
+    FILE *fh;
+    long size;
+    int64_t count;
+
+    fh = fopen(path, "rb");
+    if(fh == NULL){
+        logMessage(LOG_ERROR_LEVEL, "Opening the trace file [%s] failed.", path);
+        return(-1);
+    }
+
+    // Check the header
+    if(fread(&hdr, sizeof(hdr), 1, fh) != 1 || memcmp(hdr.magic, FS3_TRACE_MAGIC, sizeof(hdr.magic)) != 0 ||
+       hdr.version != FS3_TRACE_VERSION || hdr.recsize != sizeof(FS3TraceRecord)){
+        logMessage(LOG_ERROR_LEVEL, "[%s] is not an FS3 trace (version %d).", path, FS3_TRACE_VERSION);
+        fclose(fh);
+        return(-1);
+    }
+
+    // The records fill the rest of the file (a partial one at the end is dropped)
+    fseek(fh, 0, SEEK_END);
+    size = ftell(fh);
+    fseek(fh, sizeof(hdr), SEEK_SET);
+    count = (size - (long)sizeof(hdr)) / sizeof(FS3TraceRecord);
+
+    *records = malloc(sizeof(FS3TraceRecord) * (count > 0 ? count : 1));
+    if(*records == NULL || fread(*records, sizeof(FS3TraceRecord), count, fh) != (size_t)count){
+        logMessage(LOG_ERROR_LEVEL, "Reading the trace [%s] failed.", path);
+        free(*records);
+        *records = NULL;
+        fclose(fh);
+        return(-1);
+    }
+
+    fclose(fh);
+    return(count);
+}
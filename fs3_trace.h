@@ -0,0 +1,64 @@
+#ifndef FS3_TRACE_INCLUDED
+#define FS3_TRACE_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : fs3_trace.h
+//  Description    : This is the interface for the sector access traces of the
+//                   FS3 driver, written while the driver runs and read back by
+//                   the offline cache simulator (fs3_tracesim).
+//
+//  Author         : Patrick McDaniel | Matthew Sites
+//  Last Modified  : Sun 19 Nov 2021 09:36:52 AM EDT
+//
+
+// Include
+#include <stdint.h>
+#include <fs3_controller.h>
+
+// Defines
+#define FS3_TRACE_MAGIC "FS3T"      // First bytes of every trace file
+#define FS3_TRACE_VERSION 1         // Version of the record layout
+#define FS3_TRACE_BUFFER 4096       // Records buffered before they are written out
+
+// Kind of sector access
+typedef enum {
+    FS3_TRACE_READ  = 0, // Sector read through the cache
+    FS3_TRACE_WRITE = 1, // Sector written through the cache
+} FS3TraceOp;
+
+// Start of a trace file
+typedef struct FS3TraceHeader{
+    char magic[4];      // FS3_TRACE_MAGIC
+    uint16_t version;   // FS3_TRACE_VERSION
+    uint16_t recsize;   // sizeof(FS3TraceRecord), records follow the header back to back
+}FS3TraceHeader;
+
+// One sector access, in host byte order
+typedef struct FS3TraceRecord{
+    uint32_t tdelta;    // Microseconds since the previous record
+    uint16_t tsec;      // Sector accessed
+    uint16_t tbytes;    // Bytes of the sector the request covered
+    int16_t tfile;      // Handle of the file the sector belongs to
+    uint8_t ttrk;       // Track accessed
+    uint8_t top;        // FS3TraceOp
+}FS3TraceRecord;
+
+//
+// Trace Functions
+int fs3_trace_open(const char *path);
+    // Start writing sector accesses to a trace file
+
+void fs3_trace_record(FS3TraceOp op, FS3TrackIndex trk, FS3SectorIndex sct, int16_t file, int32_t bytes);
+    // Add a sector access to the trace (nothing if no trace is open)
+
+int fs3_trace_flush(void);
+    // Write the buffered records out
+
+int fs3_trace_close(void);
+    // Finish the trace file
+
+int64_t fs3_trace_load(const char *path, FS3TraceRecord **records);
+    // Read a whole trace file into memory (returns the number of records, -1 on failure)
+
+#endif
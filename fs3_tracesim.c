@@ -0,0 +1,413 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : fs3_tracesim.c
+//  Description    : This is the offline cache simulator for the FS3 filesystem.
+//                   It reads a sector access trace recorded by the client (-t),
+//                   finds the exact LRU hit ratio of every cache size in one
+//                   pass (Mattson stack distances), then replays the trace
+//                   through the real cache for every replacement policy and
+//                   each of a list of sizes.
+//
+//   Author        : Matthew Sites
+//   Last Modified : Sun 19 Nov 2021 09:36:52 AM EDT
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+// Project Includes
+#include <fs3_controller.h>
+#include <fs3_common.h>
+#include <fs3_cache.h>
+#include <fs3_trace.h>
+#include <cmpsc311_log.h>
+
+//
+// Defines
+#define FS3_TRACESIM_ARGUMENTS "hvl:s:e:w:F:"
+#define FS3_TRACESIM_MAX_SIZES 32
+#define FS3_TRACESIM_POLICIES 5
+#define FS3_DISK_SECTORS (FS3_MAX_TRACKS * FS3_TRACK_SIZE)
+#define USAGE \
+	"USAGE: fs3_tracesim [-h] [-v] [-l <logfile>] [-s <sizes>] [-e <policies>] [-w <ways>] [-F <filter>] <trace-file>\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"    -v - verbose output\n" \
+	"    -l - write log messages to the filename <logfile>\n" \
+	"    -s - comma separated cache sizes to replay, in lines (default 16 to 65535, doubling)\n" \
+	"    -e - comma separated replacement policies to replay (default lru,clock,2q,arc,s3fifo)\n" \
+	"    -w - replay a set-associative cache with <ways> lines per set\n" \
+	"    -F - cache admission filter to replay (all, second or tinylfu)\n" \
+	"\n" \
+	"    <trace-file> - sector access trace written by fs3_client -t\n" \
+	"\n" \
+
+//
+// Global Data
+const char *policyNames[FS3_TRACESIM_POLICIES] = { "lru", "clock", "2q", "arc", "s3fifo" }; // Indexed by FS3CachePolicy
+uint8_t replayPolicy[FS3_TRACESIM_POLICIES] = { 1, 1, 1, 1, 1 }; // 1 for each policy to replay
+uint16_t replaySizes[FS3_TRACESIM_MAX_SIZES];                      // Cache sizes to replay, in lines
+int replayNumSizes = 0;
+uint8_t replayWays = 0;
+FS3CacheAdmit replayAdmit = FS3_ADMIT_ALL;
+
+//
+// Functional Prototypes
+
+int trace_summary(FS3TraceRecord *recs, int64_t count);                          // Log what the trace holds
+int mattson_curve(FS3TraceRecord *recs, int64_t count);                          // Exact LRU hit ratio of every size
+int replay_trace(FS3TraceRecord *recs, int64_t count, FS3CachePolicy policy,
+				 uint16_t lines, double *ratio);                                  // Hit ratio of one cache configuration
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the FS3 trace simulator
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if successful, -1 if failure
+
+int main( int argc, char *argv[] ) {
+
+	// Local variables
+	int ch, verbose = 0, log_initialized = 0;
+	FS3TraceRecord *recs;
+	int64_t count;
+	char *tok;
+
+	// Process the command line parameters
+	while ((ch = getopt(argc, argv, FS3_TRACESIM_ARGUMENTS)) != -1) {
+
+		switch (ch) {
+		case 'h': // Help, print usage
+			fprintf( stderr, USAGE );
+			return( -1 );
+
+		case 'v': // Verbose Flag
+			verbose = 1;
+			break;
+
+		case 'l': // Set the log filename
+			initializeLogWithFilename( optarg );
+			log_initialized = 1;
+			break;
+
+		case 's': // Set the cache sizes
+			replayNumSizes = 0;
+			for (tok = strtok(optarg, ","); tok != NULL; tok = strtok(NULL, ",")) {
+				if ( (replayNumSizes == FS3_TRACESIM_MAX_SIZES) || (sscanf(tok, "%hu", &replaySizes[replayNumSizes]) != 1) ||
+					 (replaySizes[replayNumSizes] == 0) ) {
+					logMessage(LOG_ERROR_LEVEL, "Failed parsing cache sizes [%s]", tok);
+					return(-1);
+				}
+				replayNumSizes++;
+			}
+			break;
+
+		case 'e': // Set the replacement policies
+			memset(replayPolicy, 0x0, sizeof(replayPolicy));
+			for (tok = strtok(optarg, ","); tok != NULL; tok = strtok(NULL, ",")) {
+				int p;
+				for (p = 0; (p < FS3_TRACESIM_POLICIES) && (strcmp(tok, policyNames[p]) != 0); p++);
+				if ( p == FS3_TRACESIM_POLICIES ) {
+					logMessage(LOG_ERROR_LEVEL, "Unknown cache replacement policy [%s]", tok);
+					return(-1);
+				}
+				replayPolicy[p] = 1;
+			}
+			break;
+
+		case 'w': // Set the ways of a set-associative cache
+			if ( sscanf(optarg, "%hhu", &replayWays) != 1) {
+				logMessage(LOG_ERROR_LEVEL, "Failed parsing cache ways [%s]", optarg);
+				return(-1);
+			}
+			break;
+
+		case 'F': // Set the cache admission filter
+			if (strcmp(optarg, "all") == 0) {
+				replayAdmit = FS3_ADMIT_ALL;
+			} else if (strcmp(optarg, "second") == 0) {
+				replayAdmit = FS3_ADMIT_SECOND;
+			} else if (strcmp(optarg, "tinylfu") == 0) {
+				replayAdmit = FS3_ADMIT_TINYLFU;
+			} else {
+				logMessage(LOG_ERROR_LEVEL, "Unknown cache admission filter [%s]", optarg);
+				return(-1);
+			}
+			break;
+
+		default:  // Default (unknown)
+			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
+			return( -1 );
+		}
+	}
+
+	// Setup the log as needed
+	if ( ! log_initialized ) {
+		initializeLogWithFilehandle( CMPSC311_LOG_STDERR );
+	}
+	if ( verbose ) {
+		enableLogLevels(LOG_INFO_LEVEL);
+	}
+
+	// The trace file should be the next option
+	if ( optind >= argc ) {
+		fprintf( stderr, "Missing command line parameters, use -h to see usage, aborting.\n" );
+		return( -1 );
+	}
+
+	// Doubling sizes unless told otherwise
+	if ( replayNumSizes == 0 ) {
+		for (uint32_t lines = 16; lines <= UINT16_MAX; lines *= 2) {
+			replaySizes[replayNumSizes++] = lines;
+		}
+		replaySizes[replayNumSizes++] = UINT16_MAX;
+	}
+
+	// Read the trace in
+	if ( (count = fs3_trace_load(argv[optind], &recs)) == -1 ) {
+		return( -1 );
+	}
+
+	// Describe it, curve it, replay it
+	if ( (trace_summary(recs, count) == -1) || (mattson_curve(recs, count) == -1) ) {
+		free(recs);
+		return( -1 );
+	}
+
+	printf("\nReplay hit ratio (write-through, %s, admission %s):\n", replayWays ? "set-associative" : "fully associative",
+		(replayAdmit == FS3_ADMIT_ALL) ? "all" : ((replayAdmit == FS3_ADMIT_SECOND) ? "second" : "tinylfu"));
+	printf("   lines");
+	for (int p = 0; p < FS3_TRACESIM_POLICIES; p++) {
+		if ( replayPolicy[p] ) {
+			printf(" %8s", policyNames[p]);
+		}
+	}
+	printf("\n");
+
+	for (int s = 0; s < replayNumSizes; s++) {
+		printf("  %6d", replaySizes[s]);
+		for (int p = 0; p < FS3_TRACESIM_POLICIES; p++) {
+			double ratio;
+			if ( ! replayPolicy[p] ) {
+				continue;
+			}
+			if ( replay_trace(recs, count, (FS3CachePolicy)p, replaySizes[s], &ratio) == -1 ) {
+				printf(" %8s", "-");
+			} else {
+				printf(" %7.2f%%", ratio);
+			}
+		}
+		printf("\n");
+		fflush(stdout);
+	}
+
+	// Return successfully
+	free(recs);
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : trace_summary
+// Description  : Prints what the trace holds, and checks every record is on the
+//                disk
+//
+// Inputs       : recs - the trace records
+//                count - number of records
+// Outputs      : 0 if successful, -1 if failure
+
+int trace_summary(FS3TraceRecord *recs, int64_t count) {
+
+	// Local variables
+	int64_t reads = 0, writes = 0, usec = 0;
+	int32_t sectors = 0, files = 0;
+	uint8_t *seenSector = calloc(FS3_DISK_SECTORS, sizeof(uint8_t));
+	uint8_t *seenFile = calloc(INT16_MAX + 1, sizeof(uint8_t));
+
+	if ( (seenSector == NULL) || (seenFile == NULL) ) {
+		logMessage(LOG_ERROR_LEVEL, "Out of memory summarizing the trace.");
+		free(seenSector);
+		free(seenFile);
+		return( -1 );
+	}
+
+	for (int64_t i = 0; i < count; i++) {
+		FS3TraceRecord *r = &recs[i];
+
+		// Reject records that could not have come from the driver
+		if ( (r->ttrk >= FS3_MAX_TRACKS) || (r->tsec >= FS3_TRACK_SIZE) || (r->top > FS3_TRACE_WRITE) || (r->tfile < 0) ) {
+			logMessage(LOG_ERROR_LEVEL, "Bad trace record %ld [op %d, track %d, sector %d, file %d].",
+				(long)i, r->top, r->ttrk, r->tsec, r->tfile);
+			free(seenSector);
+			free(seenFile);
+			return( -1 );
+		}
+
+		if ( r->top == FS3_TRACE_READ ) {
+			reads++;
+		} else {
+			writes++;
+		}
+		usec += r->tdelta;
+
+		if ( ! seenSector[r->ttrk * FS3_TRACK_SIZE + r->tsec] ) {
+			seenSector[r->ttrk * FS3_TRACK_SIZE + r->tsec] = 1;
+			sectors++;
+		}
+		if ( ! seenFile[r->tfile] ) {
+			seenFile[r->tfile] = 1;
+			files++;
+		}
+	}
+
+	printf("Trace: %ld sector accesses (%ld reads, %ld writes), %d files, %d distinct sectors, %.2f s\n",
+		(long)count, (long)reads, (long)writes, files, sectors, (double)usec / 1000000.0);
+
+	free(seenSector);
+	free(seenFile);
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : mattson_curve
+// Description  : Finds the exact LRU hit ratio of every cache size in one pass.
+//                A read hits an LRU cache of C lines when fewer than C distinct
+//                sectors were used since its last use (its stack distance); a
+//                Fenwick tree over the trace marks the last use of every sector,
+//                so each distance is a prefix sum. Writes move a sector up the
+//                stack but only reads count, like the cache hit ratio.
+//
+// Inputs       : recs - the trace records
+//                count - number of records
+// Outputs      : 0 if successful, -1 if failure
+
+int mattson_curve(FS3TraceRecord *recs, int64_t count) {
+
+	// Local variables
+	int32_t *tree, *last;
+	int64_t *hist, reads = 0, hits = 0, marks = 0;
+	int32_t key, dist, since, i;
+
+	// Positions are 32 bit
+	if ( count >= INT32_MAX ) {
+		logMessage(LOG_ERROR_LEVEL, "Trace too long for the stack distance pass [%ld records].", (long)count);
+		return( -1 );
+	}
+
+	tree = calloc(count + 1, sizeof(int32_t));
+	last = malloc(sizeof(int32_t) * FS3_DISK_SECTORS);
+	hist = calloc(FS3_DISK_SECTORS + 1, sizeof(int64_t));
+	if ( (tree == NULL) || (last == NULL) || (hist == NULL) ) {
+		logMessage(LOG_ERROR_LEVEL, "Out of memory for the stack distance pass.");
+		free(tree);
+		free(last);
+		free(hist);
+		return( -1 );
+	}
+	memset(last, 0xff, sizeof(int32_t) * FS3_DISK_SECTORS);
+
+	for (i = 0; i < count; i++) {
+		key = recs[i].ttrk * FS3_TRACK_SIZE + recs[i].tsec;
+
+		if ( last[key] != -1 ) {
+			// Distinct sectors used since, the marks after its last use
+			since = 0;
+			for (int32_t j = last[key] + 1; j > 0; j -= j & -j) {
+				since += tree[j];
+			}
+			dist = marks - since;
+			if ( recs[i].top == FS3_TRACE_READ ) {
+				hist[dist]++;
+			}
+
+			// Its last use moves up to now
+			for (int32_t j = last[key] + 1; j <= count; j += j & -j) {
+				tree[j]--;
+			}
+			marks--;
+		}
+		if ( recs[i].top == FS3_TRACE_READ ) {
+			reads++;
+		}
+
+		for (int32_t j = i + 1; j <= count; j += j & -j) {
+			tree[j]++;
+		}
+		marks++;
+		last[key] = i;
+	}
+
+	// Hit ratio at doubling sizes, up to where every reuse hits
+	printf("\nLRU hit ratio by cache size (exact, Mattson stack distances):\n");
+	dist = 0;
+	for (int32_t lines = 16; reads > 0; lines *= 2) {
+		while ( dist < lines ) {
+			hits += hist[dist++];
+		}
+		printf("  %6d lines   [%.2f%%]\n", lines, 100.0 * (double)hits / (double)reads);
+		if ( (lines >= marks) || (lines >= FS3_DISK_SECTORS) ) {
+			break;
+		}
+	}
+
+	free(tree);
+	free(last);
+	free(hist);
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : replay_trace
+// Description  : Replays the trace through a write-through cache of one policy
+//                and size, the same cache calls the driver makes: a read is a
+//                get, filling the cache on a miss, a write is a put
+//
+// Inputs       : recs - the trace records
+//                count - number of records
+//                policy - the replacement policy
+//                lines - the cache size in lines
+//                ratio - set to the hit ratio in percent
+// Outputs      : 0 if successful, -1 if failure
+
+int replay_trace(FS3TraceRecord *recs, int64_t count, FS3CachePolicy policy, uint16_t lines, double *ratio) {
+
+	// Local variables
+	char sector[FS3_SECTOR_SIZE];
+
+	// Contents do not matter, only which sectors are cached
+	memset(sector, 0x0, FS3_SECTOR_SIZE);
+
+	if ( (fs3_set_cache_policy(policy) == -1) || (fs3_set_cache_ways(replayWays) == -1) ||
+		 (fs3_set_cache_admission(replayAdmit) == -1) || (fs3_init_cache(lines) == -1) ) {
+		return( -1 );
+	}
+
+	for (int64_t i = 0; i < count; i++) {
+		if ( recs[i].top == FS3_TRACE_READ ) {
+			if ( (fs3_get_cache(recs[i].ttrk, recs[i].tsec) == NULL) &&
+				 (fs3_put_cache(recs[i].ttrk, recs[i].tsec, sector) == -1) ) {
+				fs3_close_cache();
+				return( -1 );
+			}
+		} else if ( fs3_put_cache(recs[i].ttrk, recs[i].tsec, sector) == -1 ) {
+			fs3_close_cache();
+			return( -1 );
+		}
+	}
+
+	*ratio = fs3_cache_hit_ratio();
+	return( fs3_close_cache() );
+}